@@ -0,0 +1,92 @@
+#include "Aabb.h"
+
+#include <math.h>
+
+Aabb Aabb_empty()
+{
+    return (Aabb)
+    {
+        .min = {INFINITY, INFINITY, INFINITY},
+        .max = {-INFINITY, -INFINITY, -INFINITY}
+    };
+}
+
+Aabb Aabb_addPoint(Aabb box, Vec3 point)
+{
+    box.min.x = fminf(box.min.x, point.x);
+    box.min.y = fminf(box.min.y, point.y);
+    box.min.z = fminf(box.min.z, point.z);
+    box.max.x = fmaxf(box.max.x, point.x);
+    box.max.y = fmaxf(box.max.y, point.y);
+    box.max.z = fmaxf(box.max.z, point.z);
+    return box;
+}
+
+Aabb Aabb_merge(Aabb a, Aabb b)
+{
+    a.min.x = fminf(a.min.x, b.min.x);
+    a.min.y = fminf(a.min.y, b.min.y);
+    a.min.z = fminf(a.min.z, b.min.z);
+    a.max.x = fmaxf(a.max.x, b.max.x);
+    a.max.y = fmaxf(a.max.y, b.max.y);
+    a.max.z = fmaxf(a.max.z, b.max.z);
+    return a;
+}
+
+Aabb Aabb_pad(Aabb box, float amt)
+{
+    Vec3 pad = {amt, amt, amt};
+    box.min = Vec3_sub(box.min, pad);
+    box.max = Vec3_add(box.max, pad);
+    return box;
+}
+
+Vec3 Aabb_centroid(Aabb box)
+{
+    return Vec3_mulScalar(Vec3_add(box.min, box.max), 0.5f);
+}
+
+float Aabb_surfaceArea(Aabb box)
+{
+    Vec3 d = Vec3_sub(box.max, box.min);
+    if (d.x < 0.0f || d.y < 0.0f || d.z < 0.0f)
+    {
+        return 0.0f;
+    }
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static float Aabb_min(float a, float b)
+{
+    return a < b ? a : b;
+}
+
+static float Aabb_max(float a, float b)
+{
+    return a > b ? a : b;
+}
+
+// Slab test, returns the distance at which the ray enters the box or -1 if it misses it before maxT
+float Aabb_intersect(Aabb box, Vec3 start, Vec3 invDir, float maxT)
+{
+    float tx1 = (box.min.x - start.x) * invDir.x;
+    float tx2 = (box.max.x - start.x) * invDir.x;
+    float tMin = Aabb_min(tx1, tx2);
+    float tMax = Aabb_max(tx1, tx2);
+
+    float ty1 = (box.min.y - start.y) * invDir.y;
+    float ty2 = (box.max.y - start.y) * invDir.y;
+    tMin = Aabb_max(tMin, Aabb_min(ty1, ty2));
+    tMax = Aabb_min(tMax, Aabb_max(ty1, ty2));
+
+    float tz1 = (box.min.z - start.z) * invDir.z;
+    float tz2 = (box.max.z - start.z) * invDir.z;
+    tMin = Aabb_max(tMin, Aabb_min(tz1, tz2));
+    tMax = Aabb_min(tMax, Aabb_max(tz1, tz2));
+
+    if (tMax < tMin || tMax < 0.0f || tMin > maxT)
+    {
+        return -1.0f;
+    }
+    return tMin < 0.0f ? 0.0f : tMin;
+}
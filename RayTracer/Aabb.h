@@ -0,0 +1,26 @@
+#ifndef AABB_H_INCLUDED
+#define AABB_H_INCLUDED
+
+#include "Vec3.h"
+
+typedef struct Aabb
+{
+    Vec3 min;
+    Vec3 max;
+} Aabb;
+
+Aabb Aabb_empty();
+
+Aabb Aabb_addPoint(Aabb box, Vec3 point);
+
+Aabb Aabb_merge(Aabb a, Aabb b);
+
+Aabb Aabb_pad(Aabb box, float amt);
+
+Vec3 Aabb_centroid(Aabb box);
+
+float Aabb_surfaceArea(Aabb box);
+
+float Aabb_intersect(Aabb box, Vec3 start, Vec3 invDir, float maxT);
+
+#endif // AABB_H_INCLUDED
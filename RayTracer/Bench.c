@@ -0,0 +1,549 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "Vec3.h"
+#include "Mat4.h"
+#include "Mat3x4.h"
+#include "Material.h"
+#include "Shapes.h"
+#include "Scene.h"
+#include "MathFunctions.h"
+#include "Timer.h"
+#include "Cpu.h"
+
+#define RAY_COUNT 100000
+#define REPEATS 20
+#define PACK_SPHERES 64
+#define SKY_WIDTH 2048
+#define SKY_HEIGHT 1024
+#define QUARTIC_RANGE 10.0f
+
+// Every run fires the same rays, whatever the platform's rand() does
+#define BENCH_SEED 1234u
+
+/*
+    A case runs the kernel on every ray and returns a sum of its results, so the compiler can't drop the work.
+    Cases that find hits count them in *hits, the others leave it at -1.
+*/
+typedef float (*BenchFunc)(Vec3 starts[], Vec3 dirs[], int count, int *hits);
+
+// reference names the case that this one is an optimized version of, it is NULL for the references themselves
+typedef struct BenchCase
+{
+    const char *name;
+    BenchFunc func;
+    const char *reference;
+} BenchCase;
+
+typedef struct BenchResult
+{
+    double minNs;
+    double medianNs;
+    double maxNs;
+    int hits;
+} BenchResult;
+
+// Coefficients of c4*t^4 + c3*t^3 + c2*t^2 + c1*t + c0, one polynomial per ray
+typedef struct Quartic
+{
+    float c[5];
+} Quartic;
+
+static Plane plane;
+static Sphere sphere;
+static Torus torus;
+static Sphere packSpheres[PACK_SPHERES];
+static SpherePack *pack;
+static Scene *skyScene;
+static Scene *planeScene;
+static Scene *sphereScene;
+static Scene *torusScene;
+static Quartic *quartics;
+
+// Results are summed into this so the compiler can't drop the work being timed
+static volatile float sink;
+
+static uint32_t randomState = BENCH_SEED;
+
+// xorshift32, the same sequence everywhere
+static uint32_t randomNext()
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+static float randomFloat(float min, float max)
+{
+    return min + (max - min) * (randomNext() >> 8) * (1.0f / 16777216.0f);
+}
+
+// How Plane_intersect and Torus_intersect transformed rays before the inverse was precomputed
+static float transformMat4(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < count; i++)
+    {
+        Vec3 st = Mat4_mulVec3(Mat4_mul(torus.rotateInverse, torus.translateInverse), starts[i]);
+        Vec3 dr = Mat4_mulVec3(torus.rotateInverse, dirs[i]);
+        sum += st.x + st.y + st.z + dr.x + dr.y + dr.z;
+    }
+    return sum;
+}
+
+static float transformMat3x4(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < count; i++)
+    {
+        Vec3 st = Mat3x4_mulVec3(&torus.worldToLocal, starts[i]);
+        Vec3 dr = Mat3x4_mulDir(&torus.worldToLocal, dirs[i]);
+        sum += st.x + st.y + st.z + dr.x + dr.y + dr.z;
+    }
+    return sum;
+}
+
+static float sphereTranslateMat4(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < count; i++)
+    {
+        Vec3 st = Mat4_mulVec3(sphere.translateInverse, starts[i]);
+        sum += st.x + st.y + st.z;
+    }
+    return sum;
+}
+
+static float sphereTranslateSub(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < count; i++)
+    {
+        Vec3 st = Vec3_sub(starts[i], sphere.center);
+        sum += st.x + st.y + st.z;
+    }
+    return sum;
+}
+
+// The primitive intersectors return a negative distance on a miss
+static float countHit(float t, int *hits)
+{
+    if (t > 0.0f)
+        (*hits)++;
+    return t;
+}
+
+static float planeIntersect(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    float sum = 0.0f;
+    Vec3 hit;
+    *hits = 0;
+    for (int i = 0; i < count; i++)
+        sum += countHit(Plane_intersect(&plane, starts[i], dirs[i], &hit), hits);
+    return sum;
+}
+
+static float sphereIntersect(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    float sum = 0.0f;
+    Vec3 hit;
+    *hits = 0;
+    for (int i = 0; i < count; i++)
+        sum += countHit(Sphere_intersect(&sphere, starts[i], dirs[i], &hit), hits);
+    return sum;
+}
+
+static float torusIntersect(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    float sum = 0.0f;
+    Vec3 hit;
+    *hits = 0;
+    for (int i = 0; i < count; i++)
+        sum += countHit(Torus_intersect(&torus, starts[i], dirs[i], &hit), hits);
+    return sum;
+}
+
+static float torusIntersectSampled(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    float sum = 0.0f;
+    Vec3 hit;
+    *hits = 0;
+    for (int i = 0; i < count; i++)
+        sum += countHit(Torus_intersectSampled(&torus, starts[i], dirs[i], &hit), hits);
+    return sum;
+}
+
+// The single primitive scenes, so the branch of the closest hit search for each type is timed on its own
+static float sceneIntersect(Scene *scene, Vec3 starts[], Vec3 dirs[], int count, int *hits, CpuLevel level)
+{
+    Scene_setCpuLevel(scene, level);
+    float sum = 0.0f;
+    SceneHit hit;
+    *hits = 0;
+    for (int i = 0; i < count; i++)
+    {
+        *hits += Scene_intersect(scene, starts[i], dirs[i], &hit);
+        sum += hit.t;
+    }
+    return sum;
+}
+
+static float scenePlane(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    return sceneIntersect(planeScene, starts, dirs, count, hits, Cpu_getLevel());
+}
+
+static float sceneSphereScalar(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    return sceneIntersect(sphereScene, starts, dirs, count, hits, CPU_LEVEL_SCALAR);
+}
+
+static float sceneSphereBest(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    return sceneIntersect(sphereScene, starts, dirs, count, hits, Cpu_getLevel());
+}
+
+static float sceneTorus(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    return sceneIntersect(torusScene, starts, dirs, count, hits, Cpu_getLevel());
+}
+
+static float quarticFunction(float t, void *data)
+{
+    const float *c = ((Quartic*) data)->c;
+    return (((c[4] * t + c[3]) * t + c[2]) * t + c[1]) * t + c[0];
+}
+
+// First root in (0, QUARTIC_RANGE) by sampling and bisection, with the settings the sampled torus solver uses
+static float quarticSampled(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    float sum = 0.0f;
+    *hits = 0;
+    for (int i = 0; i < count; i++)
+    {
+        float root;
+        if (MathFunctions_findRootsF(quarticFunction, &quartics[i], 0.0f, QUARTIC_RANGE, &root, 1, 50, 25) > 0)
+        {
+            sum += root;
+            (*hits)++;
+        }
+    }
+    return sum;
+}
+
+static float quarticAnalytic(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    float sum = 0.0f;
+    *hits = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const float *c = quartics[i].c;
+        double roots[4];
+        int rootCount = MathFunctions_solveQuartic(c[4], c[3], c[2], c[1], c[0], roots);
+        double first = QUARTIC_RANGE;
+        for (int r = 0; r < rootCount; r++)
+        {
+            if (roots[r] > 0.0 && roots[r] < first)
+                first = roots[r];
+        }
+        if (first < QUARTIC_RANGE)
+        {
+            sum += first;
+            (*hits)++;
+        }
+    }
+    return sum;
+}
+
+// Closest hit among PACK_SPHERES spheres, one at a time from the array of structs and then through the packed kernel
+static float sphereArrayClosest(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    float sum = 0.0f;
+    Vec3 hit;
+    *hits = 0;
+    for (int i = 0; i < count; i++)
+    {
+        float closestT = 1000.0f;
+        for (int s = 0; s < PACK_SPHERES; s++)
+        {
+            float t = Sphere_intersect(&packSpheres[s], starts[i], dirs[i], &hit);
+            if (t > 0.0f && t < closestT)
+                closestT = t;
+        }
+        *hits += closestT < 1000.0f;
+        sum += closestT;
+    }
+    return sum;
+}
+
+static float spherePackClosest(Vec3 starts[], Vec3 dirs[], int count, int *hits, CpuLevel level)
+{
+    float sum = 0.0f;
+    *hits = 0;
+    for (int i = 0; i < count; i++)
+    {
+        float closestT = 1000.0f;
+        *hits += SpherePack_intersect(pack, starts[i], dirs[i], &closestT, level) >= 0;
+        sum += closestT;
+    }
+    return sum;
+}
+
+static float spherePackScalar(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    return spherePackClosest(starts, dirs, count, hits, CPU_LEVEL_SCALAR);
+}
+
+static float spherePackBest(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    return spherePackClosest(starts, dirs, count, hits, Cpu_getLevel());
+}
+
+// An empty scene, every ray goes straight to the sky lookup
+static float skyTrace(Vec3 starts[], Vec3 dirs[], int count, SkyLookup lookup)
+{
+    Scene_setSkyLookup(skyScene, lookup);
+    float sum = 0.0f;
+    for (int i = 0; i < count; i++)
+        sum += Scene_trace(skyScene, starts[i], dirs[i], NULL).x;
+    return sum;
+}
+
+static float skyEquirect(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    return skyTrace(starts, dirs, count, SKY_LOOKUP_EQUIRECT);
+}
+
+static float skyCubemap(Vec3 starts[], Vec3 dirs[], int count, int *hits)
+{
+    return skyTrace(starts, dirs, count, SKY_LOOKUP_CUBEMAP);
+}
+
+static const BenchCase cases[] = {
+    {"transform, Mat4 product per ray", transformMat4, NULL},
+    {"transform, precomputed Mat3x4", transformMat3x4, "transform, Mat4 product per ray"},
+    {"sphere translate, Mat4", sphereTranslateMat4, NULL},
+    {"sphere translate, Vec3_sub", sphereTranslateSub, "sphere translate, Mat4"},
+    {"Plane_intersect", planeIntersect, NULL},
+    {"Sphere_intersect", sphereIntersect, NULL},
+    {"Torus_intersectSampled", torusIntersectSampled, NULL},
+    {"Torus_intersect", torusIntersect, "Torus_intersectSampled"},
+    {"quartic, findRootsF", quarticSampled, NULL},
+    {"quartic, solveQuartic", quarticAnalytic, "quartic, findRootsF"},
+    {"scene plane", scenePlane, NULL},
+    {"scene sphere, scalar", sceneSphereScalar, NULL},
+    {"scene sphere, best level", sceneSphereBest, "scene sphere, scalar"},
+    {"scene torus", sceneTorus, NULL},
+    {"64 spheres, Sphere_intersect", sphereArrayClosest, NULL},
+    {"64 spheres, SpherePack scalar", spherePackScalar, "64 spheres, Sphere_intersect"},
+    {"64 spheres, SpherePack best level", spherePackBest, "64 spheres, SpherePack scalar"},
+    {"sky miss, equirect atan2/asin", skyEquirect, NULL},
+    {"sky miss, cubemap", skyCubemap, "sky miss, equirect atan2/asin"}
+};
+
+static int compareTimes(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t*) a;
+    int64_t y = *(const int64_t*) b;
+    return (x > y) - (x < y);
+}
+
+// Times REPEATS runs over the same rays. The median is what gets compared, the range shows how noisy the runs were.
+static BenchResult runCase(const BenchCase *benchCase, Vec3 starts[], Vec3 dirs[], int count)
+{
+    int64_t times[REPEATS];
+    int hits = -1;
+    for (int r = 0; r < REPEATS; r++)
+    {
+        int64_t begin = Timer_getMicroseconds();
+        sink += benchCase->func(starts, dirs, count, &hits);
+        times[r] = Timer_getMicroseconds() - begin;
+    }
+    qsort(times, REPEATS, sizeof times[0], compareTimes);
+
+    BenchResult result;
+    result.minNs = times[0] * 1000.0 / count;
+    result.medianNs = times[REPEATS / 2] * 1000.0 / count;
+    result.maxNs = times[REPEATS - 1] * 1000.0 / count;
+    result.hits = hits;
+    return result;
+}
+
+// Roots in (0, QUARTIC_RANGE) where a root is real, the second pair of roots is complex half of the time
+static Quartic randomQuartic()
+{
+    double r0 = randomFloat(0.0f, QUARTIC_RANGE);
+    double r1 = randomFloat(-QUARTIC_RANGE, QUARTIC_RANGE);
+    double a = randomFloat(0.0f, QUARTIC_RANGE);
+    double b = randomFloat(0.0f, 2.0f);
+
+    // (t - r0)(t - r1) times either (t - a)^2 - b^2 or (t - a)^2 + b^2
+    double p1 = -(r0 + r1), p0 = r0 * r1;
+    double q1 = -2.0 * a, q0 = a * a + (randomNext() & 1 ? b * b : -b * b);
+    Quartic quartic = {{p0 * q0, p1 * q0 + p0 * q1, q0 + p1 * q1 + p0, q1 + p1, 1.0f}};
+    return quartic;
+}
+
+// The checks print what went wrong and return how many cases failed, a failure makes the run exit with 1
+static int checkCubicRoots()
+{
+    // x^3 + a*x^2 + b*x + c from known roots, the first three have three real roots and the last has one
+    const double cubics[][4] = {
+        {-6.0, 11.0, -6.0, 3.0},     // 1, 2, 3
+        {-2.0, -13.0, -10.0, 5.0},   // -2, -1, 5
+        {3.25, -2.875, 0.5, 0.5},    // -4, 0.25, 0.5
+        {-2.0, 1.0, -2.0, 2.0}       // 2 and a complex pair
+    };
+    int failures = 0;
+    for (int i = 0; i < (int) (sizeof(cubics) / sizeof(cubics[0])); i++)
+    {
+        const double *cubic = cubics[i];
+        double root = MathFunctions_largestCubicRoot(cubic[0], cubic[1], cubic[2]);
+        if (!(fabs(root - cubic[3]) <= 1e-9 * fmax(1.0, fabs(cubic[3]))))
+        {
+            printf("check failed: largest root of cubic %d is %.17g, expected %g\n", i, root, cubic[3]);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+/*
+    Shading must come out the same with and without the light grid. The scene mixes small lights with one of
+    infinite range, one whose range overflows to infinity when squared and one far larger than the rest, and
+    the floor reaches well outside the grid.
+*/
+static int checkLightGrid(Vec3 starts[], Vec3 dirs[], int count)
+{
+    Material material = Material_create((Vec3) {0.8f, 0.8f, 0.8f}, (Vec3) {0.5f, 0.5f, 0.5f}, 0.3f);
+    Scene *scene = Scene_create();
+    Scene_addPlane(scene, (Vec3) {0.0f, -2.0f, 0.0f}, 200.0f, 200.0f, 0.0f, 0.0f, material);
+    Scene_addSphere(scene, (Vec3) {0.0f, 0.0f, 0.0f}, 1.5f, material);
+    Scene_addSphere(scene, (Vec3) {1.5f, 1.0f, -1.0f}, 0.7f, material);
+    for (int i = 0; i < 200; i++)
+    {
+        Vec3 pos = {randomFloat(-8.0f, 8.0f), randomFloat(-1.5f, 4.0f), randomFloat(-8.0f, 8.0f)};
+        Scene_addPointLight(scene, pos, (Vec3) {0.05f, 0.04f, 0.03f}, randomFloat(1.0f, 3.0f));
+        if (i == 50)
+            Scene_addPointLight(scene, (Vec3) {0.0f, 10.0f, 0.0f}, (Vec3) {0.2f, 0.2f, 0.2f}, INFINITY);
+        else if (i == 100)
+            Scene_addPointLight(scene, (Vec3) {5.0f, 6.0f, 5.0f}, (Vec3) {0.1f, 0.2f, 0.1f}, 1e20f);
+        else if (i == 150)
+            Scene_addPointLight(scene, (Vec3) {-4.0f, 3.0f, 2.0f}, (Vec3) {0.1f, 0.1f, 0.2f}, 400.0f);
+    }
+    Scene_update(scene);
+
+    int failures = 0;
+    for (int i = 0; i < count && failures < 10; i++)
+    {
+        Scene_setLightGridEnabled(scene, 1);
+        Vec3 withGrid = Scene_trace(scene, starts[i], dirs[i], NULL);
+        Scene_setLightGridEnabled(scene, 0);
+        Vec3 withoutGrid = Scene_trace(scene, starts[i], dirs[i], NULL);
+        if (memcmp(&withGrid, &withoutGrid, sizeof withGrid) != 0)
+        {
+            printf("check failed: ray %d shades (%g, %g, %g) with the light grid and (%g, %g, %g) without\n", i,
+                   withGrid.x, withGrid.y, withGrid.z, withoutGrid.x, withoutGrid.y, withoutGrid.z);
+            failures++;
+        }
+    }
+    Scene_destroy(scene);
+    return failures;
+}
+
+static Scene *singleShapeScene(int shape, Material material)
+{
+    Scene *scene = Scene_create();
+    if (shape == 0)
+        Scene_addPlane(scene, (Vec3) {0.0f, -1.0f, 0.0f}, 10.0f, 10.0f, 0.3f, 0.1f, material);
+    else if (shape == 1)
+        Scene_addSphere(scene, (Vec3) {0.5f, 0.0f, -0.5f}, 1.0f, material);
+    else
+        Scene_addTorus(scene, (Vec3) {0.0f, 0.0f, 0.0f}, 1.5f, 0.4f, 0.7f, 0.4f, material);
+    Scene_update(scene);
+    return scene;
+}
+
+int main()
+{
+    Material material = Material_create((Vec3) {1.0f, 1.0f, 1.0f}, (Vec3) {1.0f, 1.0f, 1.0f}, 0.5f);
+    plane = Plane_create((Vec3) {0.0f, -1.0f, 0.0f}, 10.0f, 10.0f, 0.3f, 0.1f, material);
+    sphere = Sphere_create((Vec3) {0.5f, 0.0f, -0.5f}, 1.0f, material);
+    torus = Torus_create((Vec3) {0.0f, 0.0f, 0.0f}, 1.5f, 0.4f, 0.7f, 0.4f, material);
+    pack = SpherePack_create();
+    for (int i = 0; i < PACK_SPHERES; i++)
+    {
+        Vec3 center = {randomFloat(-2.0f, 2.0f), randomFloat(-2.0f, 2.0f), randomFloat(-2.0f, 2.0f)};
+        float radius = randomFloat(0.05f, 0.3f);
+        packSpheres[i] = Sphere_create(center, radius, material);
+        SpherePack_add(pack, center, radius);
+    }
+
+    uint8_t *sky = malloc(SKY_WIDTH * SKY_HEIGHT * 3);
+    for (int i = 0; i < SKY_WIDTH * SKY_HEIGHT * 3; i++)
+        sky[i] = randomNext();
+    skyScene = Scene_create();
+    Scene_setSky(skyScene, sky, SKY_WIDTH, SKY_HEIGHT, 1, 1);
+
+    planeScene = singleShapeScene(0, material);
+    sphereScene = singleShapeScene(1, material);
+    torusScene = singleShapeScene(2, material);
+
+    // Rays start on a shell around the shapes and aim at points near the origin, so a good share of them hit
+    Vec3 *starts = malloc(RAY_COUNT * sizeof(Vec3));
+    Vec3 *dirs = malloc(RAY_COUNT * sizeof(Vec3));
+    for (int i = 0; i < RAY_COUNT; i++)
+    {
+        Vec3 start = Vec3_norm((Vec3) {randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f)});
+        starts[i] = Vec3_mulScalar(start, 6.0f);
+        Vec3 target = (Vec3) {randomFloat(-2.0f, 2.0f), randomFloat(-2.0f, 2.0f), randomFloat(-2.0f, 2.0f)};
+        dirs[i] = Vec3_norm(Vec3_sub(target, starts[i]));
+    }
+    quartics = malloc(RAY_COUNT * sizeof(Quartic));
+    for (int i = 0; i < RAY_COUNT; i++)
+    {
+        quartics[i] = randomQuartic();
+    }
+
+    // The checks draw their own random numbers after the timed cases' data, which stays the same with or without them
+    int failures = checkCubicRoots() + checkLightGrid(starts, dirs, RAY_COUNT);
+    if (failures == 0)
+        printf("checks passed\n");
+
+    printf("CPU level: %s, %d rays, seed %u, %d runs each\n", Cpu_getLevelName(Cpu_getLevel()), RAY_COUNT, BENCH_SEED, REPEATS);
+    printf("%-36s %10s %10s %10s %8s %9s\n", "case", "ns/ray", "min", "max", "hits", "vs ref");
+    int caseCount = sizeof(cases) / sizeof(cases[0]);
+    BenchResult results[sizeof(cases) / sizeof(cases[0])];
+    for (int i = 0; i < caseCount; i++)
+    {
+        results[i] = runCase(&cases[i], starts, dirs, RAY_COUNT);
+        printf("%-36s %10.2f %10.2f %10.2f", cases[i].name, results[i].medianNs, results[i].minNs, results[i].maxNs);
+        if (results[i].hits >= 0)
+            printf(" %7.1f%%", 100.0 * results[i].hits / RAY_COUNT);
+        else
+            printf(" %8s", "-");
+
+        // References always come before the cases measured against them
+        for (int r = 0; r < i && cases[i].reference; r++)
+        {
+            if (strcmp(cases[r].name, cases[i].reference) == 0)
+                printf(" %8.2fx", results[r].medianNs / results[i].medianNs);
+        }
+        printf("\n");
+    }
+
+    SpherePack_destroy(pack);
+    Scene_destroy(skyScene);
+    Scene_destroy(planeScene);
+    Scene_destroy(sphereScene);
+    Scene_destroy(torusScene);
+    free(sky);
+    free(quartics);
+    free(starts);
+    free(dirs);
+    return failures > 0;
+}
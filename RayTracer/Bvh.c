@@ -0,0 +1,256 @@
+#include "Bvh.h"
+
+#include <stdlib.h>
+#include <float.h>
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF 4
+#define BVH_MAX_DEPTH 60
+#define BVH_STACK_SIZE (BVH_MAX_DEPTH + 2)
+
+// Interior nodes keep their children at left and left + 1, leaves keep count primitives starting at first
+typedef struct BvhNode
+{
+    Aabb bounds;
+    int leftOrFirst;
+    int count;
+} BvhNode;
+
+struct Bvh
+{
+    BvhNode *nodes;
+    int nodesPtr;
+    int primitiveCount;
+    int *primitives;
+    Aabb *primitiveBounds;
+    Vec3 *centroids;
+};
+
+static float Vec3_component(Vec3 v, int axis)
+{
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// Cost of splitting a node at the best of BVH_BINS centroid planes, measured with the surface area heuristic
+static float Bvh_findSplit(Bvh *bvh, BvhNode *node, int *bestAxis, float *bestPos)
+{
+    float bestCost = FLT_MAX;
+    int first = node->leftOrFirst;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float cMin = FLT_MAX;
+        float cMax = -FLT_MAX;
+        for (int i = first; i < first + node->count; i++)
+        {
+            float c = Vec3_component(bvh->centroids[bvh->primitives[i]], axis);
+            cMin = c < cMin ? c : cMin;
+            cMax = c > cMax ? c : cMax;
+        }
+        if (cMin == cMax)
+            continue;
+
+        Aabb binBounds[BVH_BINS];
+        int binCounts[BVH_BINS] = {0};
+        for (int b = 0; b < BVH_BINS; b++)
+        {
+            binBounds[b] = Aabb_empty();
+        }
+        float scale = BVH_BINS / (cMax - cMin);
+        for (int i = first; i < first + node->count; i++)
+        {
+            int prim = bvh->primitives[i];
+            int b = (int) ((Vec3_component(bvh->centroids[prim], axis) - cMin) * scale);
+            b = b >= BVH_BINS ? BVH_BINS - 1 : b;
+            binCounts[b]++;
+            binBounds[b] = Aabb_merge(binBounds[b], bvh->primitiveBounds[prim]);
+        }
+
+        // Sweep from both sides so every split plane is evaluated in linear time
+        float leftArea[BVH_BINS - 1];
+        int leftCount[BVH_BINS - 1];
+        Aabb box = Aabb_empty();
+        int count = 0;
+        for (int b = 0; b < BVH_BINS - 1; b++)
+        {
+            box = Aabb_merge(box, binBounds[b]);
+            count += binCounts[b];
+            leftArea[b] = Aabb_surfaceArea(box);
+            leftCount[b] = count;
+        }
+        box = Aabb_empty();
+        count = 0;
+        for (int b = BVH_BINS - 1; b > 0; b--)
+        {
+            box = Aabb_merge(box, binBounds[b]);
+            count += binCounts[b];
+            float cost = leftCount[b - 1] * leftArea[b - 1] + count * Aabb_surfaceArea(box);
+            if (leftCount[b - 1] > 0 && count > 0 && cost < bestCost)
+            {
+                bestCost = cost;
+                *bestAxis = axis;
+                *bestPos = cMin + b / scale;
+            }
+        }
+    }
+    return bestCost;
+}
+
+static void Bvh_subdivide(Bvh *bvh, int nodeIndex, int depth)
+{
+    BvhNode *node = &bvh->nodes[nodeIndex];
+    if (node->count <= 1 || depth >= BVH_MAX_DEPTH)
+        return;
+
+    int axis = 0;
+    float pos = 0.0f;
+    float splitCost = Bvh_findSplit(bvh, node, &axis, &pos);
+    float leafCost = node->count * Aabb_surfaceArea(node->bounds);
+    if (splitCost >= leafCost && node->count <= BVH_MAX_LEAF)
+        return;
+    if (splitCost == FLT_MAX)
+        return;
+
+    // Partition the primitive indices around the split plane
+    int i = node->leftOrFirst;
+    int j = i + node->count - 1;
+    while (i <= j)
+    {
+        if (Vec3_component(bvh->centroids[bvh->primitives[i]], axis) < pos)
+        {
+            i++;
+        }
+        else
+        {
+            int temp = bvh->primitives[i];
+            bvh->primitives[i] = bvh->primitives[j];
+            bvh->primitives[j--] = temp;
+        }
+    }
+    int leftCount = i - node->leftOrFirst;
+    if (leftCount == 0 || leftCount == node->count)
+        return;
+
+    int left = bvh->nodesPtr;
+    bvh->nodesPtr += 2;
+    for (int c = 0; c < 2; c++)
+    {
+        BvhNode *child = &bvh->nodes[left + c];
+        child->leftOrFirst = c == 0 ? node->leftOrFirst : i;
+        child->count = c == 0 ? leftCount : node->count - leftCount;
+        child->bounds = Aabb_empty();
+        for (int k = child->leftOrFirst; k < child->leftOrFirst + child->count; k++)
+        {
+            child->bounds = Aabb_merge(child->bounds, bvh->primitiveBounds[bvh->primitives[k]]);
+        }
+    }
+    node->leftOrFirst = left;
+    node->count = 0;
+
+    Bvh_subdivide(bvh, left, depth + 1);
+    Bvh_subdivide(bvh, left + 1, depth + 1);
+}
+
+// Builds a hierarchy over count primitives, primitive i being bounded by bounds[i]
+Bvh *Bvh_create(Aabb bounds[], int count)
+{
+    Bvh *bvh = malloc(sizeof *bvh);
+    if (bvh)
+    {
+        int maxNodes = count > 0 ? 2 * count - 1 : 1;
+        bvh->nodes = malloc(sizeof *bvh->nodes * maxNodes);
+        bvh->nodesPtr = 1;
+        bvh->primitiveCount = count;
+        bvh->primitives = malloc(sizeof *bvh->primitives * (count > 0 ? count : 1));
+        bvh->primitiveBounds = malloc(sizeof *bvh->primitiveBounds * (count > 0 ? count : 1));
+        bvh->centroids = malloc(sizeof *bvh->centroids * (count > 0 ? count : 1));
+        if (!bvh->nodes || !bvh->primitives || !bvh->primitiveBounds || !bvh->centroids)
+        {
+            Bvh_destroy(bvh);
+            bvh = NULL;
+        }
+        else
+        {
+            BvhNode *root = &bvh->nodes[0];
+            root->leftOrFirst = 0;
+            root->count = count;
+            root->bounds = Aabb_empty();
+            for (int i = 0; i < count; i++)
+            {
+                bvh->primitives[i] = i;
+                bvh->primitiveBounds[i] = bounds[i];
+                bvh->centroids[i] = Aabb_centroid(bounds[i]);
+                root->bounds = Aabb_merge(root->bounds, bounds[i]);
+            }
+            Bvh_subdivide(bvh, 0, 0);
+
+            free(bvh->centroids);
+            bvh->centroids = NULL;
+        }
+    }
+    return bvh;
+}
+
+/*
+    Calls hit for every primitive whose bounds the ray enters before maxT, nearest node first.
+    hit returns the new maxT, or a negative value to end the traversal early. Returns the final maxT.
+*/
+float Bvh_traverse(Bvh *bvh, Vec3 start, Vec3 rayDir, float maxT, Bvh_HitFunc hit, void *data)
+{
+    Vec3 invDir = {1.0f / rayDir.x, 1.0f / rayDir.y, 1.0f / rayDir.z};
+    int stack[BVH_STACK_SIZE];
+    int stackPtr = 0;
+
+    if (bvh->primitiveCount == 0 || Aabb_intersect(bvh->nodes[0].bounds, start, invDir, maxT) < 0.0f)
+        return maxT;
+    stack[stackPtr++] = 0;
+
+    while (stackPtr > 0)
+    {
+        BvhNode *node = &bvh->nodes[stack[--stackPtr]];
+        if (node->count > 0)
+        {
+            for (int i = node->leftOrFirst; i < node->leftOrFirst + node->count; i++)
+            {
+                maxT = hit(bvh->primitives[i], start, rayDir, maxT, data);
+                if (maxT < 0.0f)
+                    return maxT;
+            }
+            continue;
+        }
+
+        int near = node->leftOrFirst;
+        int far = near + 1;
+        float tNear = Aabb_intersect(bvh->nodes[near].bounds, start, invDir, maxT);
+        float tFar = Aabb_intersect(bvh->nodes[far].bounds, start, invDir, maxT);
+        if (tFar >= 0.0f && (tNear < 0.0f || tFar < tNear))
+        {
+            int temp = near;
+            near = far;
+            far = temp;
+            float tempT = tNear;
+            tNear = tFar;
+            tFar = tempT;
+        }
+        // Push the far child first so the near one is visited next
+        if (tFar >= 0.0f)
+        {
+            stack[stackPtr++] = far;
+        }
+        if (tNear >= 0.0f)
+        {
+            stack[stackPtr++] = near;
+        }
+    }
+    return maxT;
+}
+
+void Bvh_destroy(Bvh *bvh)
+{
+    free(bvh->nodes);
+    free(bvh->primitives);
+    free(bvh->primitiveBounds);
+    free(bvh->centroids);
+
+    free(bvh);
+}
@@ -0,0 +1,17 @@
+#ifndef BVH_H_INCLUDED
+#define BVH_H_INCLUDED
+
+#include "Vec3.h"
+#include "Aabb.h"
+
+typedef struct Bvh Bvh;
+
+typedef float (*Bvh_HitFunc)(int primitive, Vec3 start, Vec3 rayDir, float maxT, void *data);
+
+Bvh *Bvh_create(Aabb bounds[], int count);
+
+float Bvh_traverse(Bvh *bvh, Vec3 start, Vec3 rayDir, float maxT, Bvh_HitFunc hit, void *data);
+
+void Bvh_destroy(Bvh *bvh);
+
+#endif // BVH_H_INCLUDED
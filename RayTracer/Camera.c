@@ -7,11 +7,17 @@
 #include "Vec3.h"
 #include "Mat4.h"
 
+#if CPU_DISPATCH
+#include <immintrin.h>
+#endif
+
 struct Camera
 {
     int width;
     int height;
-    Vec3 *rays;
+    float centerX;
+    float centerY;
+    float pixelScale;
 
     Vec3 pos;
     float yaw;
@@ -29,42 +35,93 @@ Camera *Camera_create(int width, int height, float fov)
     {
         cam->width = width;
         cam->height = height;
+        cam->centerX = width * 0.5f;
+        cam->centerY = height * 0.5f;
+        cam->pixelScale = tan(fov * 0.5f * M_PI / 180.0f) * 2.0f / width;
         Camera_set(cam, (Vec3){.x = 0.0f, .y = 0.0f, .z = 0.0f}, 0.0f, 0.0f);
-        cam->rays = malloc(sizeof *cam->rays * width * height);
-        if (!cam->rays || width % 2 == 1 || height % 2 == 1)
-        {
-            Camera_destroy(cam);
-            cam = NULL;
-        }
-        else
-        {
-            float su = tan(fov * 0.5f * M_PI / 180.0f) * 2.0f / width;
-            int halfWidth = width / 2;
-            int halfHeight = height / 2;
-
-            Vec3 v;
-            for (int y = 0; y < height; y++)
-            {
-                for (int x = 0; x < width; x++)
-                {
-                    v.x = (x - halfWidth + 0.5f) * su;
-                    v.y = (y - halfHeight + 0.5f) * su;
-                    v.z = 1.0f;
-                    cam->rays[x + y * width] = Vec3_norm(v);
-                }
-            }
-        }
     }
     return cam;
 }
 
-Vec3 Camera_vectorAt(Camera *cam, int x, int y)
+// Returns the ray through a point of the image given in pixel units, pixel (x, y) covers [x, x + 1) by [y, y + 1). The image plane sits at distance 1 and is centered for odd sizes as well as even ones.
+Vec3 Camera_vectorAtPoint(Camera *cam, float x, float y)
 {
-    Vec3 v = cam->rays[x + y * cam->width];
+    Vec3 v;
+    v.x = (x - cam->centerX) * cam->pixelScale;
+    v.y = (y - cam->centerY) * cam->pixelScale;
+    v.z = 1.0f;
+    v = Vec3_norm(v);
     v = Vec3_add(Vec3_add(Vec3_mulScalar(cam->right, v.x), Vec3_mulScalar(cam->up, v.y)), Vec3_mulScalar(cam->forward, v.z));
     return v;
 }
 
+// The ray through the center of pixel (x, y)
+Vec3 Camera_vectorAt(Camera *cam, int x, int y)
+{
+    return Camera_vectorAtPoint(cam, x + 0.5f, y + 0.5f);
+}
+
+// Inverse of Camera_vectorAtPoint. dir points from the camera position and need not be normalized. Returns 0 if it points behind the image plane.
+int Camera_project(Camera *cam, Vec3 dir, float *x, float *y)
+{
+    float z = Vec3_dot(dir, cam->forward);
+    if (z <= 0.0f)
+        return 0;
+    float invScale = 1.0f / (z * cam->pixelScale);
+    *x = Vec3_dot(dir, cam->right) * invScale + cam->centerX;
+    *y = Vec3_dot(dir, cam->up) * invScale + cam->centerY;
+    return 1;
+}
+
+#if CPU_DISPATCH
+// Eight rays at a time. Every step is a correctly rounded single operation, so the rays match Camera_vectorAt exactly.
+CPU_TARGET_AVX2 static int Camera_rowVectorsAvx(Camera *cam, int y, int xStart, int xStep, int count, Vec3 rayDirs[])
+{
+    __m256 v = _mm256_set1_ps((y + 0.5f - cam->centerY) * cam->pixelScale);
+    __m256 vSq = _mm256_mul_ps(v, v);
+    __m256 half = _mm256_set1_ps(0.5f);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 centerX = _mm256_set1_ps(cam->centerX);
+    __m256 scale = _mm256_set1_ps(cam->pixelScale);
+    __m256i steps = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(xStep));
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i xs = _mm256_add_epi32(_mm256_set1_epi32(xStart + i * xStep), steps);
+        __m256 u = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_cvtepi32_ps(xs), half), centerX), scale);
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(u, u), vSq), one));
+        __m256 nx = _mm256_div_ps(u, len);
+        __m256 ny = _mm256_div_ps(v, len);
+        __m256 nz = _mm256_div_ps(one, len);
+
+        float dx[8], dy[8], dz[8];
+        _mm256_storeu_ps(dx, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(cam->right.x), nx), _mm256_mul_ps(_mm256_set1_ps(cam->up.x), ny)), _mm256_mul_ps(_mm256_set1_ps(cam->forward.x), nz)));
+        _mm256_storeu_ps(dy, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(cam->right.y), nx), _mm256_mul_ps(_mm256_set1_ps(cam->up.y), ny)), _mm256_mul_ps(_mm256_set1_ps(cam->forward.y), nz)));
+        _mm256_storeu_ps(dz, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(cam->right.z), nx), _mm256_mul_ps(_mm256_set1_ps(cam->up.z), ny)), _mm256_mul_ps(_mm256_set1_ps(cam->forward.z), nz)));
+        for (int lane = 0; lane < 8; lane++)
+        {
+            rayDirs[i + lane] = (Vec3) {dx[lane], dy[lane], dz[lane]};
+        }
+    }
+    return i;
+}
+#endif
+
+// Fills rayDirs with the rays through count pixels of row y, starting at column xStart and xStep columns apart
+void Camera_rowVectors(Camera *cam, int y, int xStart, int xStep, int count, Vec3 rayDirs[], CpuLevel level)
+{
+    int i = 0;
+#if CPU_DISPATCH
+    if (level >= CPU_LEVEL_AVX2)
+        i = Camera_rowVectorsAvx(cam, y, xStart, xStep, count, rayDirs);
+#endif
+    for (; i < count; i++)
+    {
+        rayDirs[i] = Camera_vectorAt(cam, xStart + i * xStep, y);
+    }
+}
+
 void Camera_set(Camera *camera, Vec3 pos, float yaw, float pitch)
 {
     camera->pos = pos;
@@ -102,6 +159,12 @@ void Camera_moveRight(Camera *camera, float amt)
     Camera_move(camera, mv, 0.0f, 0.0f);
 }
 
+// Both cameras must have been created with the same size
+void Camera_copy(Camera *dest, Camera *src)
+{
+    *dest = *src;
+}
+
 Vec3 Camera_getPos(Camera *camera)
 {
     return camera->pos;
@@ -109,7 +172,5 @@ Vec3 Camera_getPos(Camera *camera)
 
 void Camera_destroy(Camera *camera)
 {
-    free(camera->rays);
-
     free(camera);
 }
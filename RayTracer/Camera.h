@@ -2,12 +2,18 @@
 #define CAMERA_H_INCLUDED
 
 #include "Vec3.h"
+#include "Cpu.h"
 
 typedef struct Camera Camera;
 
 Camera *Camera_create(int width, int height, float fov);
 
 Vec3 Camera_vectorAt(Camera *cam, int x, int y);
+Vec3 Camera_vectorAtPoint(Camera *cam, float x, float y);
+
+int Camera_project(Camera *cam, Vec3 dir, float *x, float *y);
+
+void Camera_rowVectors(Camera *cam, int y, int xStart, int xStep, int count, Vec3 rayDirs[], CpuLevel level);
 
 void Camera_set(Camera *camera, Vec3 pos, float yaw, float pitch);
 
@@ -19,6 +25,8 @@ void Camera_moveRight(Camera *camera, float amt);
 
 Vec3 Camera_getPos(Camera *camera);
 
+void Camera_copy(Camera *dest, Camera *src);
+
 void Camera_destroy(Camera *camera);
 
 #endif // CAMERA_H_INCLUDED
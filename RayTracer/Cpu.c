@@ -0,0 +1,23 @@
+#include "Cpu.h"
+
+CpuLevel Cpu_getLevel()
+{
+#if CPU_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return CPU_LEVEL_AVX2;
+#endif
+    return CPU_LEVEL_SCALAR;
+}
+
+const char *Cpu_getLevelName(CpuLevel level)
+{
+    switch (level)
+    {
+    case CPU_LEVEL_AVX2:
+        return "AVX2";
+    case CPU_LEVEL_SCALAR:
+    default:
+        return "scalar";
+    }
+}
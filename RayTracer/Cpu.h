@@ -0,0 +1,26 @@
+#ifndef CPU_H_INCLUDED
+#define CPU_H_INCLUDED
+
+// Instruction set levels that hot kernels are compiled for, in increasing order
+typedef enum CpuLevel
+{
+    CPU_LEVEL_SCALAR,
+    CPU_LEVEL_AVX2
+} CpuLevel;
+
+// Per-function target attributes let one binary carry a build of a kernel for each level. Elsewhere only the scalar build exists.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_DISPATCH 1
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#define CPU_INLINE inline __attribute__((always_inline))
+#else
+#define CPU_DISPATCH 0
+#define CPU_INLINE inline
+#endif
+
+// Returns the highest level the running processor supports
+CpuLevel Cpu_getLevel();
+
+const char *Cpu_getLevelName(CpuLevel level);
+
+#endif // CPU_H_INCLUDED
@@ -0,0 +1,112 @@
+#include "Cubemap.h"
+
+#include <stdlib.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#define _1_PI 1.0/M_PI
+#define _1_2PI 1.0/(M_PI*2)
+
+extern inline Vec3 Cubemap_lookup(Cubemap *cubemap, Vec3 dir);
+
+#define CUBEMAP_TILE_EMPTY 0
+#define CUBEMAP_TILE_FILLING 1
+
+// pixels is a latitude-longitude image, it is read as tiles get filled and must outlive the cubemap
+Cubemap *Cubemap_create(const uint8_t *pixels, int width, int height, int faceSize)
+{
+    Cubemap *cubemap = malloc(sizeof *cubemap);
+    if (cubemap)
+    {
+        cubemap->faceSize = faceSize < 1 ? 1 : faceSize;
+        cubemap->tilesPerSide = (cubemap->faceSize + CUBEMAP_TILE - 1) / CUBEMAP_TILE;
+        cubemap->pixels = malloc(6 * cubemap->faceSize * cubemap->faceSize * 3);
+        cubemap->tileStates = malloc(sizeof *cubemap->tileStates * 6 * cubemap->tilesPerSide * cubemap->tilesPerSide);
+        cubemap->source = pixels;
+        cubemap->sourceWidth = width;
+        cubemap->sourceHeight = height;
+        if (!cubemap->pixels || !cubemap->tileStates)
+        {
+            Cubemap_destroy(cubemap);
+            cubemap = NULL;
+        }
+        else
+        {
+            for (int i = 0; i < 6 * cubemap->tilesPerSide * cubemap->tilesPerSide; i++)
+            {
+                atomic_init(&cubemap->tileStates[i], CUBEMAP_TILE_EMPTY);
+            }
+        }
+    }
+    return cubemap;
+}
+
+/*
+    Resamples one tile, each texel takes the equirectangular pixel its center points at. The first thread to
+    get here fills the tile, any other that needs it meanwhile waits, which takes far less time than tracing
+    a ray. Either way the texels come out the same, so images don't depend on which thread got there first.
+*/
+void Cubemap_fillTile(Cubemap *cubemap, int tile)
+{
+    uint8_t expected = CUBEMAP_TILE_EMPTY;
+    if (!atomic_compare_exchange_strong(&cubemap->tileStates[tile], &expected, CUBEMAP_TILE_FILLING))
+    {
+        while (atomic_load_explicit(&cubemap->tileStates[tile], memory_order_acquire) != CUBEMAP_TILE_READY)
+            ;
+        return;
+    }
+
+    int size = cubemap->faceSize;
+    int face = tile / (cubemap->tilesPerSide * cubemap->tilesPerSide);
+    int tileX = tile % cubemap->tilesPerSide * CUBEMAP_TILE;
+    int tileY = tile / cubemap->tilesPerSide % cubemap->tilesPerSide * CUBEMAP_TILE;
+    int endX = tileX + CUBEMAP_TILE < size ? tileX + CUBEMAP_TILE : size;
+    int endY = tileY + CUBEMAP_TILE < size ? tileY + CUBEMAP_TILE : size;
+    for (int y = tileY; y < endY; y++)
+    {
+        float t = (y + 0.5f) / size * 2.0f - 1.0f;
+        for (int x = tileX; x < endX; x++)
+        {
+            // Inverse of the face selection in Cubemap_lookup
+            float s = (x + 0.5f) / size * 2.0f - 1.0f;
+            Vec3 dir;
+            switch (face)
+            {
+            case 0: dir = (Vec3) {1.0f, -t, -s}; break;
+            case 1: dir = (Vec3) {-1.0f, -t, s}; break;
+            case 2: dir = (Vec3) {s, 1.0f, t}; break;
+            case 3: dir = (Vec3) {s, -1.0f, -t}; break;
+            case 4: dir = (Vec3) {s, -t, 1.0f}; break;
+            default: dir = (Vec3) {-s, -t, -1.0f}; break;
+            }
+            dir = Vec3_norm(dir);
+            if (dir.y > 1.0f) dir.y = 1.0f;
+            if (dir.y < -1.0f) dir.y = -1.0f;
+
+            Vec3 color = Cubemap_sampleEquirect(cubemap->source, cubemap->sourceWidth, cubemap->sourceHeight, dir);
+            uint8_t *texel = cubemap->pixels + ((face * size + y) * size + x) * 3;
+            texel[0] = (uint8_t) (color.x * 255.0f + 0.5f);
+            texel[1] = (uint8_t) (color.y * 255.0f + 0.5f);
+            texel[2] = (uint8_t) (color.z * 255.0f + 0.5f);
+        }
+    }
+
+    atomic_store_explicit(&cubemap->tileStates[tile], CUBEMAP_TILE_READY, memory_order_release);
+}
+
+// Nearest pixel of a latitude-longitude image in direction dir, which must be normalized
+Vec3 Cubemap_sampleEquirect(const uint8_t *pixels, int width, int height, Vec3 dir)
+{
+    float u = 0.5f + atan2(dir.z, dir.x) * _1_2PI;
+    float v = 0.5f - asin(dir.y) * _1_PI;
+    int x = (int) floor(u * (width - 1) + 0.5f);
+    int y = (int) floor(v * (height - 1) + 0.5f);
+    int loc = (x + y * width) * 3;
+    return (Vec3) {pixels[loc] / 255.0f, pixels[loc + 1] / 255.0f, pixels[loc + 2] / 255.0f};
+}
+
+void Cubemap_destroy(Cubemap *cubemap)
+{
+    free(cubemap->pixels);
+    free(cubemap->tileStates);
+    free(cubemap);
+}
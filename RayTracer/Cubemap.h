@@ -0,0 +1,88 @@
+#ifndef CUBEMAP_H_INCLUDED
+#define CUBEMAP_H_INCLUDED
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "Vec3.h"
+#include "Cpu.h"
+
+// Faces are filled in tiles of this many texels square
+#define CUBEMAP_TILE 32
+#define CUBEMAP_TILE_READY 2
+
+/*
+    Six square RGB faces stored one after another, in the order +X, -X, +Y, -Y, +Z, -Z. A tile is only
+    resampled from the source image the first time a lookup lands in it, so creating a cubemap costs nothing
+    and only the parts of the source that are looked at are ever read.
+*/
+typedef struct Cubemap
+{
+    int faceSize;
+    int tilesPerSide;
+    uint8_t *pixels;
+    _Atomic uint8_t *tileStates;
+
+    const uint8_t *source;
+    int sourceWidth;
+    int sourceHeight;
+} Cubemap;
+
+Cubemap *Cubemap_create(const uint8_t *pixels, int width, int height, int faceSize);
+
+Vec3 Cubemap_sampleEquirect(const uint8_t *pixels, int width, int height, Vec3 dir);
+
+void Cubemap_fillTile(Cubemap *cubemap, int tile);
+
+// Nearest texel in direction dir, which need not be normalized. The major axis picks the face, one divide projects onto it.
+// Forced inline, the compiler otherwise leaves it out of the large tracing kernels.
+CPU_INLINE Vec3 Cubemap_lookup(Cubemap *cubemap, Vec3 dir)
+{
+    float ax = fabsf(dir.x);
+    float ay = fabsf(dir.y);
+    float az = fabsf(dir.z);
+
+    int face;
+    float major, s, t;
+    if (ax >= ay && ax >= az)
+    {
+        face = dir.x > 0.0f ? 0 : 1;
+        major = ax;
+        s = dir.x > 0.0f ? -dir.z : dir.z;
+        t = -dir.y;
+    }
+    else if (ay >= az)
+    {
+        face = dir.y > 0.0f ? 2 : 3;
+        major = ay;
+        s = dir.x;
+        t = dir.y > 0.0f ? dir.z : -dir.z;
+    }
+    else
+    {
+        face = dir.z > 0.0f ? 4 : 5;
+        major = az;
+        s = dir.z > 0.0f ? dir.x : -dir.x;
+        t = -dir.y;
+    }
+
+    int size = cubemap->faceSize;
+    float scale = 0.5f * size / major;
+    int x = (int) (s * scale + 0.5f * size);
+    int y = (int) (t * scale + 0.5f * size);
+    x = x < 0 ? 0 : x >= size ? size - 1 : x;
+    y = y < 0 ? 0 : y >= size ? size - 1 : y;
+
+    int tile = (face * cubemap->tilesPerSide + y / CUBEMAP_TILE) * cubemap->tilesPerSide + x / CUBEMAP_TILE;
+    if (atomic_load_explicit(&cubemap->tileStates[tile], memory_order_acquire) != CUBEMAP_TILE_READY)
+    {
+        Cubemap_fillTile(cubemap, tile);
+    }
+
+    const uint8_t *texel = cubemap->pixels + ((face * size + y) * size + x) * 3;
+    return (Vec3) {texel[0] / 255.0f, texel[1] / 255.0f, texel[2] / 255.0f};
+}
+
+void Cubemap_destroy(Cubemap *cubemap);
+
+#endif // CUBEMAP_H_INCLUDED
@@ -67,7 +67,7 @@ void CurvePath_addWaypoint(CurvePath *path, Vec3 point)
 // t ranges from 0-1
 Vec3 CurvePath_interpolate(CurvePath *path, float t)
 {
-    float totalT = t * path->curvesSize;
+    float totalT = t * path->curvesPtr;
     int curveIndex = (int) floor(totalT);
     float curveT = fmod(totalT, 1.0f);
     if (curveIndex >= path->curvesPtr)
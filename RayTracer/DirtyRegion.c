@@ -0,0 +1,124 @@
+#include "DirtyRegion.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The pixels of an image that changed, both as a flag per row and as the bounding rectangle of all changes. The rectangle is empty when minX > maxX.
+struct DirtyRegion
+{
+    int width;
+    int height;
+    uint8_t *rows;
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+};
+
+// A new region covers the whole image
+DirtyRegion *DirtyRegion_create(int width, int height)
+{
+    DirtyRegion *region = malloc(sizeof *region);
+    if (region)
+    {
+        region->width = width;
+        region->height = height;
+        region->rows = malloc(height > 0 ? height : 1);
+        if (!region->rows)
+        {
+            DirtyRegion_destroy(region);
+            region = NULL;
+        }
+        else
+        {
+            DirtyRegion_markAll(region);
+        }
+    }
+    return region;
+}
+
+// Records that pixels xMin to xMax of row y changed
+void DirtyRegion_markRow(DirtyRegion *region, int y, int xMin, int xMax)
+{
+    region->rows[y] = 1;
+    if (xMin < region->minX) region->minX = xMin;
+    if (xMax > region->maxX) region->maxX = xMax;
+    if (y < region->minY) region->minY = y;
+    if (y > region->maxY) region->maxY = y;
+}
+
+void DirtyRegion_markAll(DirtyRegion *region)
+{
+    memset(region->rows, 1, region->height);
+    region->minX = 0;
+    region->minY = 0;
+    region->maxX = region->width - 1;
+    region->maxY = region->height - 1;
+}
+
+void DirtyRegion_clear(DirtyRegion *region)
+{
+    if (DirtyRegion_isDirty(region))
+    {
+        memset(region->rows + region->minY, 0, region->maxY - region->minY + 1);
+    }
+    region->minX = region->width;
+    region->minY = region->height;
+    region->maxX = -1;
+    region->maxY = -1;
+}
+
+// Adds the changes in src to those in dest, both must cover images of the same size
+void DirtyRegion_merge(DirtyRegion *dest, DirtyRegion *src)
+{
+    if (!DirtyRegion_isDirty(src))
+        return;
+
+    for (int y = src->minY; y <= src->maxY; y++)
+    {
+        dest->rows[y] |= src->rows[y];
+    }
+    if (src->minX < dest->minX) dest->minX = src->minX;
+    if (src->minY < dest->minY) dest->minY = src->minY;
+    if (src->maxX > dest->maxX) dest->maxX = src->maxX;
+    if (src->maxY > dest->maxY) dest->maxY = src->maxY;
+}
+
+void DirtyRegion_copy(DirtyRegion *dest, DirtyRegion *src)
+{
+    memcpy(dest->rows, src->rows, src->height);
+    dest->minX = src->minX;
+    dest->minY = src->minY;
+    dest->maxX = src->maxX;
+    dest->maxY = src->maxY;
+}
+
+// Returns 0 when nothing changed
+int DirtyRegion_isDirty(DirtyRegion *region)
+{
+    return region->minX <= region->maxX;
+}
+
+int DirtyRegion_isRowDirty(DirtyRegion *region, int y)
+{
+    return region->rows[y];
+}
+
+// Gets the bounding rectangle of all changes. Returns 0 and leaves the outputs untouched when nothing changed.
+int DirtyRegion_getRect(DirtyRegion *region, int *x, int *y, int *width, int *height)
+{
+    if (!DirtyRegion_isDirty(region))
+        return 0;
+
+    *x = region->minX;
+    *y = region->minY;
+    *width = region->maxX - region->minX + 1;
+    *height = region->maxY - region->minY + 1;
+    return 1;
+}
+
+void DirtyRegion_destroy(DirtyRegion *region)
+{
+    free(region->rows);
+
+    free(region);
+}
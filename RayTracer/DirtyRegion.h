@@ -0,0 +1,22 @@
+#ifndef DIRTYREGION_H_INCLUDED
+#define DIRTYREGION_H_INCLUDED
+
+#include <stdint.h>
+
+typedef struct DirtyRegion DirtyRegion;
+
+DirtyRegion *DirtyRegion_create(int width, int height);
+
+void DirtyRegion_markRow(DirtyRegion *region, int y, int xMin, int xMax);
+void DirtyRegion_markAll(DirtyRegion *region);
+void DirtyRegion_clear(DirtyRegion *region);
+void DirtyRegion_merge(DirtyRegion *dest, DirtyRegion *src);
+void DirtyRegion_copy(DirtyRegion *dest, DirtyRegion *src);
+
+int DirtyRegion_isDirty(DirtyRegion *region);
+int DirtyRegion_isRowDirty(DirtyRegion *region, int y);
+int DirtyRegion_getRect(DirtyRegion *region, int *x, int *y, int *width, int *height);
+
+void DirtyRegion_destroy(DirtyRegion *region);
+
+#endif // DIRTYREGION_H_INCLUDED
@@ -1,11 +1,14 @@
 #include "Framebuffer.h"
 #include <stdlib.h>
+#include <string.h>
 
+// dirty tracks which pixels changed since it was last cleared, typically when the buffer was last presented
 struct Framebuffer
 {
     int width;
     int height;
     uint8_t *pixels;
+    DirtyRegion *dirty;
 };
 
 Framebuffer *Framebuffer_create(int width, int height)
@@ -16,7 +19,8 @@ Framebuffer *Framebuffer_create(int width, int height)
         buffer->width = width;
         buffer->height = height;
         buffer->pixels = malloc(3 * width * height);
-        if (!buffer->pixels)
+        buffer->dirty = DirtyRegion_create(width, height);
+        if (!buffer->pixels || !buffer->dirty)
         {
             Framebuffer_destroy(buffer);
             buffer = NULL;
@@ -49,11 +53,29 @@ void Framebuffer_clear(Framebuffer *buffer, uint8_t r, uint8_t g, uint8_t b)
         buffer->pixels[i + 1] = g;
         buffer->pixels[i + 2] = b;
     }
+    DirtyRegion_markAll(buffer->dirty);
+}
+
+// Both buffers must have the same size. The dirty region is copied along with the pixels.
+void Framebuffer_copy(Framebuffer *dest, Framebuffer *src)
+{
+    memcpy(dest->pixels, src->pixels, 3 * src->width * src->height);
+    DirtyRegion_copy(dest->dirty, src->dirty);
+}
+
+// Writers mark what they change here, presenters read it to upload only those pixels and clear it afterwards
+DirtyRegion *Framebuffer_getDirtyRegion(Framebuffer *buffer)
+{
+    return buffer->dirty;
 }
 
 void Framebuffer_destroy(Framebuffer *buffer)
 {
     free(buffer->pixels);
+    if (buffer->dirty)
+    {
+        DirtyRegion_destroy(buffer->dirty);
+    }
 
     free(buffer);
 }
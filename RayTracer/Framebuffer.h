@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "DirtyRegion.h"
+
 typedef struct Framebuffer Framebuffer;
 
 Framebuffer *Framebuffer_create(int width, int height);
@@ -14,6 +16,10 @@ uint8_t *Framebuffer_getPixels(Framebuffer *buffer);
 
 void Framebuffer_clear(Framebuffer *buffer, uint8_t r, uint8_t g, uint8_t b);
 
+void Framebuffer_copy(Framebuffer *dest, Framebuffer *src);
+
+DirtyRegion *Framebuffer_getDirtyRegion(Framebuffer *buffer);
+
 void Framebuffer_destroy(Framebuffer *buffer);
 
 #endif // FRAMEBUFFER_H_INCLUDED
@@ -0,0 +1,71 @@
+#include "HdrBuffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Unclamped sums of every sample traced for each pixel, alongside how many samples went into each sum
+struct HdrBuffer
+{
+    int width;
+    int height;
+    float *colors;
+    uint16_t *sampleCounts;
+};
+
+HdrBuffer *HdrBuffer_create(int width, int height)
+{
+    HdrBuffer *buffer = malloc(sizeof *buffer);
+    if (buffer)
+    {
+        buffer->width = width;
+        buffer->height = height;
+        buffer->colors = calloc(3 * width * height, sizeof *buffer->colors);
+        buffer->sampleCounts = calloc(width * height, sizeof *buffer->sampleCounts);
+        if (!buffer->colors || !buffer->sampleCounts)
+        {
+            HdrBuffer_destroy(buffer);
+            buffer = NULL;
+        }
+    }
+    return buffer;
+}
+
+int HdrBuffer_getWidth(HdrBuffer *buffer)
+{
+    return buffer->width;
+}
+
+int HdrBuffer_getHeight(HdrBuffer *buffer)
+{
+    return buffer->height;
+}
+
+// Adds one sample to the pixel and returns the average of all its samples so far. A pixel holds at most UINT16_MAX samples.
+Vec3 HdrBuffer_addSample(HdrBuffer *buffer, int x, int y, Vec3 color)
+{
+    int loc = x + y * buffer->width;
+    float *sum = &buffer->colors[loc * 3];
+    sum[0] += color.x;
+    sum[1] += color.y;
+    sum[2] += color.z;
+    float count = ++buffer->sampleCounts[loc];
+    return (Vec3) {sum[0] / count, sum[1] / count, sum[2] / count};
+}
+
+int HdrBuffer_getSampleCount(HdrBuffer *buffer, int x, int y)
+{
+    return buffer->sampleCounts[x + y * buffer->width];
+}
+
+void HdrBuffer_clear(HdrBuffer *buffer)
+{
+    memset(buffer->colors, 0, sizeof *buffer->colors * 3 * buffer->width * buffer->height);
+    memset(buffer->sampleCounts, 0, sizeof *buffer->sampleCounts * buffer->width * buffer->height);
+}
+
+void HdrBuffer_destroy(HdrBuffer *buffer)
+{
+    free(buffer->colors);
+    free(buffer->sampleCounts);
+
+    free(buffer);
+}
@@ -0,0 +1,23 @@
+#ifndef HDRBUFFER_H_INCLUDED
+#define HDRBUFFER_H_INCLUDED
+
+#include <stdint.h>
+
+#include "Vec3.h"
+
+typedef struct HdrBuffer HdrBuffer;
+
+HdrBuffer *HdrBuffer_create(int width, int height);
+
+int HdrBuffer_getWidth(HdrBuffer *buffer);
+int HdrBuffer_getHeight(HdrBuffer *buffer);
+
+Vec3 HdrBuffer_addSample(HdrBuffer *buffer, int x, int y, Vec3 color);
+
+int HdrBuffer_getSampleCount(HdrBuffer *buffer, int x, int y);
+
+void HdrBuffer_clear(HdrBuffer *buffer);
+
+void HdrBuffer_destroy(HdrBuffer *buffer);
+
+#endif // HDRBUFFER_H_INCLUDED
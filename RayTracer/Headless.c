@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "RayTracingEngine.h"
+#include "ImageWriter.h"
+#include "MappedImage.h"
+#include "Timer.h"
+
+#define SKY_WIDTH 64
+#define SKY_HEIGHT 32
+
+void fillSky(uint8_t *pixels, int width, int height);
+
+void printUsage(const char *program);
+
+int parseInt(const char *str, int min, int *out);
+
+int parseHeatmapMode(const char *str, HeatmapMode *out);
+
+int writeHeatmap(RayTracingEngine *engine, const char *path);
+
+void fatalError(char *str);
+
+/*
+    Renders the demo scene offline, with no window or OpenGL context, and writes the result to an image file.
+    The format follows the extension of the output path, .ppm or otherwise PNG. With -heatmap the image shows
+    what each pixel cost to trace instead, or holds the raw costs if the path ends in .pfm.
+*/
+int main(int argc, char **argv)
+{
+    int width = 800;
+    int height = 600;
+    int samples = 1;
+    int threads = 0;
+    const char *outPath = "render.png";
+    const char *skyPath = NULL;
+    HeatmapMode heatmap = HEATMAP_OFF;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = value != NULL;
+        if (ok && strcmp(arg, "-w") == 0)
+            ok = parseInt(value, 1, &width);
+        else if (ok && strcmp(arg, "-h") == 0)
+            ok = parseInt(value, 1, &height);
+        else if (ok && strcmp(arg, "-s") == 0)
+            ok = parseInt(value, 1, &samples);
+        else if (ok && strcmp(arg, "-t") == 0)
+            ok = parseInt(value, 0, &threads);
+        else if (ok && strcmp(arg, "-o") == 0)
+            outPath = value;
+        else if (ok && strcmp(arg, "-sky") == 0)
+            skyPath = value;
+        else if (ok && strcmp(arg, "-heatmap") == 0)
+            ok = parseHeatmapMode(value, &heatmap);
+        else
+            ok = 0;
+
+        if (!ok)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    // A whole round of blocks per call, since there is no frame to get back to in between
+    const int blockWidth = 6;
+    RayTracingEngine *engine = RayTracingEngine_create(width, height, blockWidth, 70.0f, threads, blockWidth * blockWidth);
+    if (!engine)
+    {
+        fatalError("Failed to create ray tracing engine.");
+    }
+    RayTracingEngine_setMaxSamples(engine, samples);
+    if (!RayTracingEngine_setHeatmapMode(engine, heatmap))
+    {
+        fatalError("Counting intersection tests needs a build with RT_STATS.");
+    }
+
+    // The torus is a perfect mirror, so it needs something to reflect. Without a sky image it gets a gradient.
+    Scene *scene = RayTracingEngine_getScene(engine);
+    static uint8_t gradient[SKY_WIDTH * SKY_HEIGHT * 3];
+    MappedImage *sky = NULL;
+    if (skyPath)
+    {
+        sky = MappedImage_open(skyPath);
+        if (!sky)
+        {
+            RayTracingEngine_destroy(engine);
+            fatalError("Failed to load sky image.");
+        }
+        Scene_setSky(scene, MappedImage_getPixels(sky), MappedImage_getWidth(sky), MappedImage_getHeight(sky), 0, 1);
+    }
+    else
+    {
+        fillSky(gradient, SKY_WIDTH, SKY_HEIGHT);
+        Scene_setSky(scene, gradient, SKY_WIDTH, SKY_HEIGHT, 0, 1);
+    }
+    Scene_addPointLight(scene, (Vec3) {0.0f, 0.0f, 0.0f}, (Vec3) {1.0f, 1.0f, 1.0f}, 20.0f);
+
+    Scene_addTorus(scene, (Vec3) {0.0f, 0.0f, 8.0f}, 2.0f, 1.0f, 0.0f, M_PI / 2, Material_create((Vec3) {1.0f, 1.0f, 1.0f}, (Vec3) {1.0f, 1.0f, 1.0f}, 1.0f));
+
+    int64_t start = Timer_getMicroseconds();
+    while (!RayTracingEngine_isComplete(engine))
+    {
+        RayTracingEngine_simulate(engine);
+    }
+    int64_t elapsed = Timer_getMicroseconds() - start;
+    printf("Rendered %dx%d, %d samples per pixel, on %d threads in %.3f s\n",
+           width, height, samples, RayTracingEngine_getThreadCount(engine), elapsed / 1000000.0);
+
+    int written = heatmap == HEATMAP_OFF ? ImageWriter_write(RayTracingEngine_getRenderBuffer(engine), outPath) : writeHeatmap(engine, outPath);
+    RayTracingEngine_destroy(engine);
+    if (sky)
+    {
+        MappedImage_close(sky);
+    }
+    if (!written)
+    {
+        fatalError("Failed to write image.");
+    }
+    printf("Wrote %s\n", outPath);
+
+    return 0;
+}
+
+// Latitude-longitude gradient, blue overhead fading to a pale horizon with dark ground below it
+void fillSky(uint8_t *pixels, int width, int height)
+{
+    const float zenith[3] = {60.0f, 110.0f, 200.0f};
+    const float horizon[3] = {225.0f, 230.0f, 235.0f};
+    const float ground[3] = {70.0f, 65.0f, 60.0f};
+    for (int y = 0; y < height; y++)
+    {
+        // Row 0 looks straight up
+        float v = (float) y / (height - 1);
+        uint8_t color[3];
+        for (int c = 0; c < 3; c++)
+        {
+            float value = v < 0.5f ? zenith[c] + (horizon[c] - zenith[c]) * v * 2.0f : ground[c];
+            color[c] = (uint8_t) value;
+        }
+        for (int x = 0; x < width; x++)
+        {
+            memcpy(pixels + (x + y * width) * 3, color, 3);
+        }
+    }
+}
+
+void printUsage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-w width] [-h height] [-s samples] [-t threads] [-o output.png|output.ppm] [-sky sky.ppm] [-heatmap ticks|tests]\n", program);
+    fprintf(stderr, "A thread count of 0 uses one thread per core. A heatmap can also be written to output.pfm.\n");
+    fprintf(stderr, "Counting intersection tests with -heatmap tests needs a build with RT_STATS.\n");
+}
+
+// Returns 0 unless str is a whole number no less than min
+int parseInt(const char *str, int min, int *out)
+{
+    char *end;
+    long value = strtol(str, &end, 10);
+    if (end == str || *end != '\0' || value < min || value > 65535)
+        return 0;
+    *out = (int) value;
+    return 1;
+}
+
+int parseHeatmapMode(const char *str, HeatmapMode *out)
+{
+    if (strcmp(str, "ticks") == 0)
+        *out = HEATMAP_TICKS;
+    else if (strcmp(str, "tests") == 0)
+        *out = HEATMAP_PRIMITIVE_TESTS;
+    else
+        return 0;
+    return 1;
+}
+
+// Writes the raw average cost per sample of every pixel to a .pfm path, otherwise the false color image
+int writeHeatmap(RayTracingEngine *engine, const char *path)
+{
+    int width = RayTracingEngine_getWidth(engine);
+    int height = RayTracingEngine_getHeight(engine);
+    int written = 0;
+    size_t length = strlen(path);
+    if (length >= 4 && (strcmp(path + length - 4, ".pfm") == 0 || strcmp(path + length - 4, ".PFM") == 0))
+    {
+        float *costs = malloc(sizeof *costs * width * height);
+        if (costs)
+        {
+            printf("Most expensive pixel: %.0f per sample\n", RayTracingEngine_getHeatmap(engine, costs));
+            written = ImageWriter_writePfm(costs, width, height, path);
+            free(costs);
+        }
+    }
+    else
+    {
+        Framebuffer *image = Framebuffer_create(width, height);
+        if (image)
+        {
+            RayTracingEngine_renderHeatmap(engine, image);
+            written = ImageWriter_write(image, path);
+            Framebuffer_destroy(image);
+        }
+    }
+    return written;
+}
+
+void fatalError(char *str)
+{
+    fprintf(stderr, "%s\n", str);
+    exit(1);
+}
@@ -0,0 +1,225 @@
+#include "ImageWriter.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    Framebuffer rows run from the bottom of the image to the top, which is what OpenGL expects. Image files
+    store the top row first, so rows are written in reverse. Every function returns 0 if the file could not
+    be written.
+*/
+
+int ImageWriter_writePpm(Framebuffer *buffer, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return 0;
+
+    int width = Framebuffer_getWidth(buffer);
+    int height = Framebuffer_getHeight(buffer);
+    uint8_t *pixels = Framebuffer_getPixels(buffer);
+
+    int ok = fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+    for (int y = height - 1; y >= 0 && ok; y--)
+    {
+        ok = fwrite(pixels + y * width * 3, 3, width, file) == (size_t) width;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+/*
+    Writes one float per pixel as a greyscale PFM. PFM stores the bottom row first like the Framebuffer, and
+    a negative scale marks the floats as little endian.
+*/
+int ImageWriter_writePfm(const float *values, int width, int height, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return 0;
+
+    const uint16_t one = 1;
+    int littleEndian = *(const uint8_t*) &one == 1;
+    int ok = fprintf(file, "Pf\n%d %d\n%s\n", width, height, littleEndian ? "-1.0" : "1.0") > 0;
+    ok = ok && fwrite(values, sizeof *values, (size_t) width * height, file) == (size_t) width * height;
+    return fclose(file) == 0 && ok;
+}
+
+// Largest amount of data a stored deflate block can hold
+#define DEFLATE_STORED_MAX 65535
+#define ADLER_MOD 65521
+
+/*
+    The PNG is written in one pass. Image data goes into a zlib stream of uncompressed (stored) deflate blocks,
+    so its size is known up front and no compression library is needed. The CRC of the current chunk and the
+    Adler-32 checksum of the zlib data are updated as bytes go out.
+*/
+typedef struct PngStream
+{
+    FILE *file;
+    int ok;
+    uint32_t crcTable[256];
+    uint32_t crc;
+    uint32_t adlerA;
+    uint32_t adlerB;
+    uint32_t dataLeft;
+    uint32_t blockLeft;
+} PngStream;
+
+static void PngStream_init(PngStream *stream, FILE *file)
+{
+    stream->file = file;
+    stream->ok = 1;
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+        {
+            c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        stream->crcTable[i] = c;
+    }
+}
+
+// Writes bytes that belong to the current chunk
+static void PngStream_put(PngStream *stream, const uint8_t *data, size_t count)
+{
+    uint32_t crc = stream->crc;
+    for (size_t i = 0; i < count; i++)
+    {
+        crc = stream->crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    stream->crc = crc;
+    if (stream->ok && fwrite(data, 1, count, stream->file) != count)
+    {
+        stream->ok = 0;
+    }
+}
+
+static void PngStream_putUint32(PngStream *stream, uint32_t value)
+{
+    uint8_t bytes[4] = {value >> 24, value >> 16, value >> 8, value};
+    PngStream_put(stream, bytes, 4);
+}
+
+// The length and type are written before the data, the CRC after it covers the type and data
+static void PngStream_beginChunk(PngStream *stream, const char *type, uint32_t length)
+{
+    uint8_t bytes[4] = {length >> 24, length >> 16, length >> 8, length};
+    if (stream->ok && fwrite(bytes, 1, 4, stream->file) != 4)
+    {
+        stream->ok = 0;
+    }
+    stream->crc = 0xffffffffu;
+    PngStream_put(stream, (const uint8_t*) type, 4);
+}
+
+static void PngStream_endChunk(PngStream *stream)
+{
+    PngStream_putUint32(stream, stream->crc ^ 0xffffffffu);
+}
+
+// Writes uncompressed image data, starting a new stored block whenever the previous one is full
+static void PngStream_putData(PngStream *stream, const uint8_t *data, size_t count)
+{
+    while (count > 0)
+    {
+        if (stream->blockLeft == 0)
+        {
+            uint32_t size = stream->dataLeft < DEFLATE_STORED_MAX ? stream->dataLeft : DEFLATE_STORED_MAX;
+            uint8_t header[5] = {size == stream->dataLeft, size, size >> 8, ~size, ~size >> 8};
+            PngStream_put(stream, header, 5);
+            stream->blockLeft = size;
+        }
+
+        size_t part = count < stream->blockLeft ? count : stream->blockLeft;
+        PngStream_put(stream, data, part);
+        for (size_t i = 0; i < part; i++)
+        {
+            stream->adlerA = (stream->adlerA + data[i]) % ADLER_MOD;
+            stream->adlerB = (stream->adlerB + stream->adlerA) % ADLER_MOD;
+        }
+        stream->blockLeft -= part;
+        stream->dataLeft -= part;
+        data += part;
+        count -= part;
+    }
+}
+
+int ImageWriter_writePng(Framebuffer *buffer, const char *path)
+{
+    int width = Framebuffer_getWidth(buffer);
+    int height = Framebuffer_getHeight(buffer);
+    uint8_t *pixels = Framebuffer_getPixels(buffer);
+
+    // Each row is preceded by its filter type, 0 for none
+    uint32_t dataSize = (uint32_t) height * (1 + width * 3);
+    uint32_t blockCount = dataSize > 0 ? (dataSize + DEFLATE_STORED_MAX - 1) / DEFLATE_STORED_MAX : 1;
+    uint32_t zlibSize = 2 + 5 * blockCount + dataSize + 4;
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return 0;
+
+    PngStream *stream = malloc(sizeof *stream);
+    if (!stream)
+    {
+        fclose(file);
+        return 0;
+    }
+    PngStream_init(stream, file);
+
+    static const uint8_t signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    if (fwrite(signature, 1, 8, file) != 8)
+    {
+        stream->ok = 0;
+    }
+
+    // 8 bits per channel RGB, default compression and filtering, not interlaced
+    PngStream_beginChunk(stream, "IHDR", 13);
+    PngStream_putUint32(stream, width);
+    PngStream_putUint32(stream, height);
+    static const uint8_t format[5] = {8, 2, 0, 0, 0};
+    PngStream_put(stream, format, 5);
+    PngStream_endChunk(stream);
+
+    PngStream_beginChunk(stream, "IDAT", zlibSize);
+    static const uint8_t zlibHeader[2] = {0x78, 0x01};
+    PngStream_put(stream, zlibHeader, 2);
+    stream->adlerA = 1;
+    stream->adlerB = 0;
+    stream->dataLeft = dataSize;
+    stream->blockLeft = 0;
+    if (dataSize == 0)
+    {
+        static const uint8_t emptyBlock[5] = {1, 0, 0, 0xff, 0xff};
+        PngStream_put(stream, emptyBlock, 5);
+    }
+    static const uint8_t filter = 0;
+    for (int y = height - 1; y >= 0; y--)
+    {
+        PngStream_putData(stream, &filter, 1);
+        PngStream_putData(stream, pixels + y * width * 3, width * 3);
+    }
+    PngStream_putUint32(stream, stream->adlerB << 16 | stream->adlerA);
+    PngStream_endChunk(stream);
+
+    PngStream_beginChunk(stream, "IEND", 0);
+    PngStream_endChunk(stream);
+
+    int ok = stream->ok;
+    free(stream);
+    return fclose(file) == 0 && ok;
+}
+
+// Picks the format from the file extension, PNG unless the path ends in .ppm
+int ImageWriter_write(Framebuffer *buffer, const char *path)
+{
+    size_t length = strlen(path);
+    if (length >= 4 && (strcmp(path + length - 4, ".ppm") == 0 || strcmp(path + length - 4, ".PPM") == 0))
+    {
+        return ImageWriter_writePpm(buffer, path);
+    }
+    return ImageWriter_writePng(buffer, path);
+}
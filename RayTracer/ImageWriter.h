@@ -0,0 +1,14 @@
+#ifndef IMAGEWRITER_H_INCLUDED
+#define IMAGEWRITER_H_INCLUDED
+
+#include "Framebuffer.h"
+
+int ImageWriter_writePpm(Framebuffer *buffer, const char *path);
+
+int ImageWriter_writePng(Framebuffer *buffer, const char *path);
+
+int ImageWriter_write(Framebuffer *buffer, const char *path);
+
+int ImageWriter_writePfm(const float *values, int width, int height, const char *path);
+
+#endif // IMAGEWRITER_H_INCLUDED
@@ -0,0 +1,251 @@
+#include "LightGrid.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "Aabb.h"
+
+extern inline int LightGrid_query(const LightGrid *grid, Vec3 point, const int **lights);
+
+#define LIGHT_GRID_CELLS_PER_LIGHT 4
+#define LIGHT_GRID_MAX_DIM 64
+
+// Lights with a radius over this many times the median are listed in every cell instead of sizing the grid
+#define LIGHT_GRID_OVERSIZED 16.0f
+
+// Cells and the grid bounds are widened by this fraction when tested against lights, so a point rounded into a neighbouring cell still finds them
+#define LIGHT_GRID_PAD 0.001f
+
+typedef enum LightPlacement
+{
+    LIGHT_UNLIT,
+    LIGHT_PLACED,
+    LIGHT_ALWAYS
+} LightPlacement;
+
+static int LightGrid_compareRadii(const void *a, const void *b)
+{
+    float x = *(const float*) a;
+    float y = *(const float*) b;
+    return (x > y) - (x < y);
+}
+
+// A sphere whose bounds overflow or are not numbers can't be placed in cells
+static int LightGrid_isFinite(Vec3 center, float radius)
+{
+    return isfinite(center.x - radius) && isfinite(center.x + radius)
+        && isfinite(center.y - radius) && isfinite(center.y + radius)
+        && isfinite(center.z - radius) && isfinite(center.z + radius);
+}
+
+/*
+    Decides where each light goes and fills the grid's always list in ascending order. Returns 0 if memory
+    ran out.
+*/
+static int LightGrid_place(LightGrid *grid, Vec3 centers[], float radii[], int count, unsigned char placement[])
+{
+    float *sorted = malloc(sizeof *sorted * (count > 0 ? count : 1));
+    if (!sorted)
+        return 0;
+
+    int finite = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (radii[i] > 0.0f && LightGrid_isFinite(centers[i], radii[i]))
+            sorted[finite++] = radii[i];
+    }
+    qsort(sorted, finite, sizeof *sorted, LightGrid_compareRadii);
+    float maxRadius = finite > 0 ? sorted[finite / 2] * LIGHT_GRID_OVERSIZED : 0.0f;
+    free(sorted);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (radii[i] <= 0.0f)
+            placement[i] = LIGHT_UNLIT;
+        else if (LightGrid_isFinite(centers[i], radii[i]) && radii[i] <= maxRadius)
+            placement[i] = LIGHT_PLACED;
+        else
+            placement[i] = LIGHT_ALWAYS;
+
+        if (placement[i] == LIGHT_ALWAYS)
+            grid->alwaysLights[grid->alwaysCount++] = i;
+    }
+    return 1;
+}
+
+static float LightGrid_distSqToBox(Vec3 point, Vec3 boxMin, Vec3 boxMax)
+{
+    float dx = point.x < boxMin.x ? boxMin.x - point.x : point.x > boxMax.x ? point.x - boxMax.x : 0.0f;
+    float dy = point.y < boxMin.y ? boxMin.y - point.y : point.y > boxMax.y ? point.y - boxMax.y : 0.0f;
+    float dz = point.z < boxMin.z ? boxMin.z - point.z : point.z > boxMax.z ? point.z - boxMax.z : 0.0f;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+static int LightGrid_clampCell(float f, int dim)
+{
+    int i = (int) floorf(f);
+    return i < 0 ? 0 : i >= dim ? dim - 1 : i;
+}
+
+/*
+    Visits every cell that light overlaps, either counting it into cellStarts[cell] or writing it at the
+    position cellStarts[cell + 1] holds, which is then advanced.
+*/
+static void LightGrid_insert(LightGrid *grid, Vec3 center, float radius, int light, int write)
+{
+    float cellSize = 1.0f / grid->invCellSize;
+    float pad = cellSize * LIGHT_GRID_PAD;
+    int x0 = LightGrid_clampCell((center.x - radius - grid->min.x) * grid->invCellSize, grid->dims[0]);
+    int y0 = LightGrid_clampCell((center.y - radius - grid->min.y) * grid->invCellSize, grid->dims[1]);
+    int z0 = LightGrid_clampCell((center.z - radius - grid->min.z) * grid->invCellSize, grid->dims[2]);
+    int x1 = LightGrid_clampCell((center.x + radius - grid->min.x) * grid->invCellSize, grid->dims[0]);
+    int y1 = LightGrid_clampCell((center.y + radius - grid->min.y) * grid->invCellSize, grid->dims[1]);
+    int z1 = LightGrid_clampCell((center.z + radius - grid->min.z) * grid->invCellSize, grid->dims[2]);
+    float reachSq = radius * radius;
+
+    for (int z = z0; z <= z1; z++)
+    {
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                Vec3 boxMin = {grid->min.x + x * cellSize - pad, grid->min.y + y * cellSize - pad, grid->min.z + z * cellSize - pad};
+                Vec3 boxMax = {boxMin.x + cellSize + 2.0f * pad, boxMin.y + cellSize + 2.0f * pad, boxMin.z + cellSize + 2.0f * pad};
+                if (LightGrid_distSqToBox(center, boxMin, boxMax) >= reachSq)
+                    continue;
+
+                int cell = (z * grid->dims[1] + y) * grid->dims[0] + x;
+                if (write)
+                    grid->lights[grid->cellStarts[cell + 1]++] = light;
+                else
+                    grid->cellStarts[cell]++;
+            }
+        }
+    }
+}
+
+// Inserts every light in order, so each cell's list comes out ascending with the always lights merged in
+static void LightGrid_insertAll(LightGrid *grid, Vec3 centers[], float radii[], const unsigned char placement[], int count, int write)
+{
+    int cellCount = grid->dims[0] * grid->dims[1] * grid->dims[2];
+    for (int i = 0; i < count; i++)
+    {
+        if (placement[i] == LIGHT_PLACED)
+        {
+            LightGrid_insert(grid, centers[i], radii[i], i, write);
+        }
+        else if (placement[i] == LIGHT_ALWAYS)
+        {
+            for (int cell = 0; cell < cellCount; cell++)
+            {
+                if (write)
+                    grid->lights[grid->cellStarts[cell + 1]++] = i;
+                else
+                    grid->cellStarts[cell]++;
+            }
+        }
+    }
+}
+
+/*
+    The cell size aims for about LIGHT_GRID_CELLS_PER_LIGHT cells per light over the bounds of the spheres of
+    the placed lights, with no more than LIGHT_GRID_MAX_DIM cells along an axis.
+*/
+LightGrid *LightGrid_create(Vec3 centers[], float radii[], int count)
+{
+    LightGrid *grid = malloc(sizeof *grid);
+    if (grid)
+    {
+        grid->cellStarts = NULL;
+        grid->lights = NULL;
+        grid->alwaysCount = 0;
+        grid->alwaysLights = malloc(sizeof *grid->alwaysLights * (count > 0 ? count : 1));
+        unsigned char *placement = malloc(count > 0 ? count : 1);
+        if (!grid->alwaysLights || !placement || !LightGrid_place(grid, centers, radii, count, placement))
+        {
+            free(placement);
+            LightGrid_destroy(grid);
+            return NULL;
+        }
+
+        Aabb bounds = Aabb_empty();
+        int lit = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (placement[i] == LIGHT_PLACED)
+            {
+                Vec3 r = {radii[i], radii[i], radii[i]};
+                bounds = Aabb_addPoint(bounds, Vec3_sub(centers[i], r));
+                bounds = Aabb_addPoint(bounds, Vec3_add(centers[i], r));
+                lit++;
+            }
+        }
+        if (lit == 0)
+        {
+            bounds.min = bounds.max = (Vec3) {0.0f, 0.0f, 0.0f};
+        }
+
+        Vec3 extent = Vec3_sub(bounds.max, bounds.min);
+        float largest = fmaxf(extent.x, fmaxf(extent.y, extent.z));
+        bounds = Aabb_pad(bounds, largest * LIGHT_GRID_PAD);
+        extent = Vec3_sub(bounds.max, bounds.min);
+        largest = fmaxf(extent.x, fmaxf(extent.y, extent.z));
+        // The volume can overflow a float when the lights are spread far apart
+        float cellSize = (float) cbrt((double) extent.x * extent.y * extent.z / (lit * LIGHT_GRID_CELLS_PER_LIGHT + 1));
+        cellSize = fmaxf(cellSize, largest / LIGHT_GRID_MAX_DIM * (1.0f + LIGHT_GRID_PAD));
+        cellSize = cellSize > 0.0f ? cellSize : 1.0f;
+
+        grid->min = bounds.min;
+        grid->invCellSize = 1.0f / cellSize;
+        float extents[3] = {extent.x, extent.y, extent.z};
+        int cellCount = 1;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int dim = (int) ceilf(extents[axis] / cellSize);
+            grid->dims[axis] = dim < 1 ? 1 : dim > LIGHT_GRID_MAX_DIM ? LIGHT_GRID_MAX_DIM : dim;
+            cellCount *= grid->dims[axis];
+        }
+
+        grid->cellStarts = calloc(cellCount + 1, sizeof *grid->cellStarts);
+        if (!grid->cellStarts)
+        {
+            free(placement);
+            LightGrid_destroy(grid);
+            return NULL;
+        }
+
+        LightGrid_insertAll(grid, centers, radii, placement, count, 0);
+
+        // Turn the counts into list starts shifted one cell along, the writes then advance each to the start of the next list
+        int total = 0;
+        for (int cell = 0; cell <= cellCount; cell++)
+        {
+            int cellLights = grid->cellStarts[cell];
+            grid->cellStarts[cell] = total;
+            total += cellLights;
+        }
+        for (int cell = cellCount; cell > 0; cell--)
+        {
+            grid->cellStarts[cell] = grid->cellStarts[cell - 1];
+        }
+
+        grid->lights = malloc(sizeof *grid->lights * (total > 0 ? total : 1));
+        if (!grid->lights)
+        {
+            free(placement);
+            LightGrid_destroy(grid);
+            return NULL;
+        }
+        LightGrid_insertAll(grid, centers, radii, placement, count, 1);
+        free(placement);
+    }
+    return grid;
+}
+
+void LightGrid_destroy(LightGrid *grid)
+{
+    free(grid->cellStarts);
+    free(grid->lights);
+    free(grid->alwaysLights);
+    free(grid);
+}
@@ -0,0 +1,49 @@
+#ifndef LIGHTGRID_H_INCLUDED
+#define LIGHTGRID_H_INCLUDED
+
+#include "Vec3.h"
+#include "Cpu.h"
+
+/*
+    Uniform grid of cubic cells over the spheres that point lights reach. Each cell lists, in ascending order,
+    the lights whose sphere overlaps it, so a point only has to look at the lights of the cell it falls in.
+    The lists are stored back to back, cell i owning lights[cellStarts[i]] up to lights[cellStarts[i + 1]].
+
+    Lights with an infinite range, or one far larger than the others, would stretch the grid until every light
+    lands in every cell. They are kept out of the bounds and listed in every cell instead, and alwaysLights
+    holds them alone for points outside the grid.
+*/
+typedef struct LightGrid
+{
+    Vec3 min;
+    float invCellSize;
+    int dims[3];
+    int *cellStarts;
+    int *lights;
+    int *alwaysLights;
+    int alwaysCount;
+} LightGrid;
+
+// Lights with a radius of 0 or less light nothing and are left out, ones that are infinite or oversized are listed everywhere
+LightGrid *LightGrid_create(Vec3 centers[], float radii[], int count);
+
+// Sets *lights to the lights that may reach point, in ascending order, and returns how many there are
+CPU_INLINE int LightGrid_query(const LightGrid *grid, Vec3 point, const int **lights)
+{
+    float x = (point.x - grid->min.x) * grid->invCellSize;
+    float y = (point.y - grid->min.y) * grid->invCellSize;
+    float z = (point.z - grid->min.z) * grid->invCellSize;
+    if (!(x >= 0.0f && x < grid->dims[0] && y >= 0.0f && y < grid->dims[1] && z >= 0.0f && z < grid->dims[2]))
+    {
+        *lights = grid->alwaysLights;
+        return grid->alwaysCount;
+    }
+
+    int cell = ((int) z * grid->dims[1] + (int) y) * grid->dims[0] + (int) x;
+    *lights = grid->lights + grid->cellStarts[cell];
+    return grid->cellStarts[cell + 1] - grid->cellStarts[cell];
+}
+
+void LightGrid_destroy(LightGrid *grid);
+
+#endif // LIGHTGRID_H_INCLUDED
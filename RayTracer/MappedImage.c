@@ -0,0 +1,167 @@
+#include "MappedImage.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+    A binary PPM (P6, maxval 255) mapped read-only into memory. Its pixel data is already tightly packed RGB,
+    so the pixels are used straight out of the mapping without a copy, and the operating system only reads
+    the pages that actually get sampled. The pixels stay valid until the image is closed.
+*/
+struct MappedImage
+{
+    int width;
+    int height;
+    uint8_t *pixels;
+
+    void *view;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+static int MappedImage_isSpace(uint8_t c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Reads the next header number, skipping whitespace and comments. Returns -1 if there is none.
+static long MappedImage_readNumber(const uint8_t *data, size_t size, size_t *pos)
+{
+    while (*pos < size && (MappedImage_isSpace(data[*pos]) || data[*pos] == '#'))
+    {
+        if (data[*pos] == '#')
+        {
+            while (*pos < size && data[*pos] != '\n')
+                (*pos)++;
+        }
+        else
+        {
+            (*pos)++;
+        }
+    }
+
+    long value = -1;
+    while (*pos < size && data[*pos] >= '0' && data[*pos] <= '9' && value < 1000000)
+    {
+        value = (value < 0 ? 0 : value * 10) + data[*pos] - '0';
+        (*pos)++;
+    }
+    return value;
+}
+
+// Finds the pixel data, returns 0 unless the file is a P6 PPM with maxval 255 and holds every pixel
+static int MappedImage_parseHeader(MappedImage *image)
+{
+    const uint8_t *data = image->view;
+    size_t size = image->size;
+    if (size < 2 || data[0] != 'P' || data[1] != '6')
+        return 0;
+
+    size_t pos = 2;
+    long width = MappedImage_readNumber(data, size, &pos);
+    long height = MappedImage_readNumber(data, size, &pos);
+    long maxVal = MappedImage_readNumber(data, size, &pos);
+    // Exactly one whitespace character separates the header from the pixels
+    if (width < 1 || height < 1 || maxVal != 255 || pos >= size || !MappedImage_isSpace(data[pos]))
+        return 0;
+    pos++;
+
+    if ((size - pos) / 3 / width < (size_t) height)
+        return 0;
+
+    image->width = width;
+    image->height = height;
+    image->pixels = (uint8_t*) data + pos;
+    return 1;
+}
+
+// Returns NULL if the file can't be mapped or isn't a PPM that can be used in place
+MappedImage *MappedImage_open(const char *path)
+{
+    MappedImage *image = malloc(sizeof *image);
+    if (!image)
+        return NULL;
+    image->view = NULL;
+
+#ifdef _WIN32
+    image->mapping = NULL;
+    image->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER fileSize;
+    if (image->file != INVALID_HANDLE_VALUE && GetFileSizeEx(image->file, &fileSize) && fileSize.QuadPart > 0)
+    {
+        image->size = (size_t) fileSize.QuadPart;
+        image->mapping = CreateFileMappingA(image->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (image->mapping)
+        {
+            image->view = MapViewOfFile(image->mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        image->size = (size_t) st.st_size;
+        image->view = mmap(NULL, image->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (image->view == MAP_FAILED)
+        {
+            image->view = NULL;
+        }
+    }
+    // The mapping keeps the file referenced on its own
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+#endif
+
+    if (!image->view || !MappedImage_parseHeader(image))
+    {
+        MappedImage_close(image);
+        image = NULL;
+    }
+    return image;
+}
+
+int MappedImage_getWidth(MappedImage *image)
+{
+    return image->width;
+}
+
+int MappedImage_getHeight(MappedImage *image)
+{
+    return image->height;
+}
+
+uint8_t *MappedImage_getPixels(MappedImage *image)
+{
+    return image->pixels;
+}
+
+void MappedImage_close(MappedImage *image)
+{
+#ifdef _WIN32
+    if (image->view)
+        UnmapViewOfFile(image->view);
+    if (image->mapping)
+        CloseHandle(image->mapping);
+    if (image->file != INVALID_HANDLE_VALUE)
+        CloseHandle(image->file);
+#else
+    if (image->view)
+        munmap(image->view, image->size);
+#endif
+    free(image);
+}
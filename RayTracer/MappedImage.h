@@ -0,0 +1,17 @@
+#ifndef MAPPEDIMAGE_H_INCLUDED
+#define MAPPEDIMAGE_H_INCLUDED
+
+#include <stdint.h>
+
+typedef struct MappedImage MappedImage;
+
+MappedImage *MappedImage_open(const char *path);
+
+int MappedImage_getWidth(MappedImage *image);
+int MappedImage_getHeight(MappedImage *image);
+
+uint8_t *MappedImage_getPixels(MappedImage *image);
+
+void MappedImage_close(MappedImage *image);
+
+#endif // MAPPEDIMAGE_H_INCLUDED
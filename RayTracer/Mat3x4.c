@@ -0,0 +1,14 @@
+#include "Mat3x4.h"
+
+// Drops the bottom row of an affine Mat4, which is always 0, 0, 0, 1
+Mat3x4 Mat3x4_fromMat4(Mat4 m)
+{
+    return (Mat3x4) {
+        m.a11, m.a12, m.a13, m.a14,
+        m.a21, m.a22, m.a23, m.a24,
+        m.a31, m.a32, m.a33, m.a34
+    };
+}
+
+extern inline Vec3 Mat3x4_mulVec3(const Mat3x4 *m, Vec3 v);
+extern inline Vec3 Mat3x4_mulDir(const Mat3x4 *m, Vec3 v);
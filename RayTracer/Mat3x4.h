@@ -0,0 +1,36 @@
+#ifndef MAT3X4_H_INCLUDED
+#define MAT3X4_H_INCLUDED
+
+#include "Vec3.h"
+#include "Mat4.h"
+
+typedef struct Mat3x4
+{
+    float a11, a12, a13, a14,
+          a21, a22, a23, a24,
+          a31, a32, a33, a34;
+} Mat3x4;
+
+Mat3x4 Mat3x4_fromMat4(Mat4 m);
+
+// Transforms a point, including the translation column
+inline Vec3 Mat3x4_mulVec3(const Mat3x4 *m, Vec3 v)
+{
+    return (Vec3) {
+        m->a11*v.x + m->a12*v.y + m->a13*v.z + m->a14,
+        m->a21*v.x + m->a22*v.y + m->a23*v.z + m->a24,
+        m->a31*v.x + m->a32*v.y + m->a33*v.z + m->a34
+    };
+}
+
+// Transforms a direction, ignoring the translation column
+inline Vec3 Mat3x4_mulDir(const Mat3x4 *m, Vec3 v)
+{
+    return (Vec3) {
+        m->a11*v.x + m->a12*v.y + m->a13*v.z,
+        m->a21*v.x + m->a22*v.y + m->a23*v.z,
+        m->a31*v.x + m->a32*v.y + m->a33*v.z
+    };
+}
+
+#endif // MAT3X4_H_INCLUDED
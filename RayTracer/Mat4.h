@@ -19,7 +19,14 @@ Mat4 Mat4_mul(Mat4 a, Mat4 b);
 
 Mat4 Mat4_mulScalar(Mat4 m, float scalar);
 
-Vec3 Mat4_mulVec3(Mat4 m, Vec3 v);
+inline Vec3 Mat4_mulVec3(Mat4 m, Vec3 v)
+{
+    return (Vec3) {
+        m.a11*v.x + m.a12*v.y + m.a13*v.z + m.a14,
+        m.a21*v.x + m.a22*v.y + m.a23*v.z + m.a24,
+        m.a31*v.x + m.a32*v.y + m.a33*v.z + m.a34
+    };
+}
 
 Mat4 Mat4_translate(Vec3 trans);
 
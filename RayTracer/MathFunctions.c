@@ -1,6 +1,7 @@
 #include "MathFunctions.h"
 
 #include <stdlib.h>
+#include <math.h>
 
 float MathFunctions_randomF(float minRange, float maxRange)
 {
@@ -57,3 +58,135 @@ int MathFunctions_findRootsF(float (*f)(float x, void *data), void *data, float
 
 	return currentRoot; // Return number of roots found
 }
+
+
+// Real roots of a*x^2 + b*x + c, returns the number of roots found
+int MathFunctions_solveQuadratic(double a, double b, double c, double roots[])
+{
+	if (a == 0.0)
+	{
+		if (b == 0.0)
+			return 0;
+		roots[0] = -c / b;
+		return 1;
+	}
+
+	double disc = b * b - 4.0 * a * c;
+	if (disc < 0.0)
+	{
+		// Let grazing hits that rounding pushed just below zero through as a double root
+		if (disc > -1e-12 * b * b)
+			disc = 0.0;
+		else
+			return 0;
+	}
+
+	// Avoids the cancellation of -b + sqrt(disc) when b is large
+	double q = -0.5 * (b + (b < 0.0 ? -sqrt(disc) : sqrt(disc)));
+	if (q == 0.0)
+	{
+		roots[0] = 0.0;
+		return 1;
+	}
+	roots[0] = q / a;
+	roots[1] = c / q;
+	return 2;
+}
+
+// Largest real root of x^3 + a*x^2 + b*x + c
+double MathFunctions_largestCubicRoot(double a, double b, double c)
+{
+	double q = (a * a - 3.0 * b) / 9.0;
+	double r = (2.0 * a * a * a - 9.0 * a * b + 27.0 * c) / 54.0;
+	double x;
+	if (r * r < q * q * q)
+	{
+		// Three real roots at -2*sqrt(q)*cos((theta + 2*pi*k)/3) - a/3, k = 1 gives the largest
+		double theta = acos(r / sqrt(q * q * q));
+		x = -2.0 * sqrt(q) * cos((theta + 2.0 * M_PI) / 3.0) - a / 3.0;
+	}
+	else
+	{
+		double u = -cbrt(r + (r < 0.0 ? -1.0 : 1.0) * sqrt(r * r - q * q * q));
+		double v = u == 0.0 ? 0.0 : q / u;
+		x = u + v - a / 3.0;
+	}
+
+	// One Newton step cleans up the trigonometric solution
+	double f = ((x + a) * x + b) * x + c;
+	double df = (3.0 * x + 2.0 * a) * x + b;
+	if (df != 0.0)
+		x -= f / df;
+	return x;
+}
+
+/*
+    Real roots of c4*x^4 + c3*x^3 + c2*x^2 + c1*x + c0 by Ferrari's method, each polished with Newton's method.
+    Returns the number of roots written to roots[], which must have room for 4.
+*/
+int MathFunctions_solveQuartic(double c4, double c3, double c2, double c1, double c0, double roots[])
+{
+	if (c4 == 0.0)
+		return 0;
+
+	double a = c3 / c4;
+	double b = c2 / c4;
+	double c = c1 / c4;
+	double d = c0 / c4;
+
+	// Substituting x = y - a/4 gives the depressed quartic y^4 + p*y^2 + q*y + r
+	double a2 = a * a;
+	double p = b - 0.375 * a2;
+	double q = c - 0.5 * a * b + 0.125 * a2 * a;
+	double r = d - 0.25 * a * c + 0.0625 * a2 * b - 0.01171875 * a2 * a2;
+
+	int count = 0;
+	if (fabs(q) < 1e-12)
+	{
+		// Biquadratic, solve for y^2
+		double z[2];
+		int zCount = MathFunctions_solveQuadratic(1.0, p, r, z);
+		for (int i = 0; i < zCount; i++)
+		{
+			if (z[i] >= 0.0)
+			{
+				roots[count++] = sqrt(z[i]);
+				roots[count++] = -sqrt(z[i]);
+			}
+		}
+	}
+	else
+	{
+		// A positive root m of the resolvent cubic splits the quartic into two quadratics
+		double m = MathFunctions_largestCubicRoot(p, 0.25 * p * p - r, -0.125 * q * q);
+		if (m <= 0.0)
+			return 0;
+		double s = sqrt(2.0 * m);
+		double y[2];
+		int yCount = MathFunctions_solveQuadratic(1.0, s, 0.5 * p + m - q / (2.0 * s), y);
+		for (int i = 0; i < yCount; i++)
+		{
+			roots[count++] = y[i];
+		}
+		yCount = MathFunctions_solveQuadratic(1.0, -s, 0.5 * p + m + q / (2.0 * s), y);
+		for (int i = 0; i < yCount; i++)
+		{
+			roots[count++] = y[i];
+		}
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		double x = roots[i] - 0.25 * a;
+		for (int iter = 0; iter < 2; iter++)
+		{
+			double f = (((x + a) * x + b) * x + c) * x + d;
+			double df = ((4.0 * x + 3.0 * a) * x + 2.0 * b) * x + c;
+			if (df == 0.0)
+				break;
+			x -= f / df;
+		}
+		roots[i] = x;
+	}
+	return count;
+}
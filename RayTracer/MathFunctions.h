@@ -9,4 +9,10 @@ float MathFunctions_bisectionMethodF(float (*f)(float x, void *data), void *data
 
 int MathFunctions_findRootsF(float (*f)(float x, void *data), void *data, float sx, float ex, float roots[], int rootCount, int tries, int iter);
 
+int MathFunctions_solveQuadratic(double a, double b, double c, double roots[]);
+
+double MathFunctions_largestCubicRoot(double a, double b, double c);
+
+int MathFunctions_solveQuartic(double c4, double c3, double c2, double c1, double c0, double roots[]);
+
 #endif // MATHFUNCTIONS_H_INCLUDED
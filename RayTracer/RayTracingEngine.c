@@ -2,6 +2,43 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "Timer.h"
+#include "Thread.h"
+#include "HdrBuffer.h"
+#include "Wavefront.h"
+
+typedef enum CameraCommandType
+{
+    CAMERA_MOVE,
+    CAMERA_MOVE_FORWARD,
+    CAMERA_MOVE_UP,
+    CAMERA_MOVE_RIGHT
+} CameraCommandType;
+
+typedef struct CameraCommand
+{
+    CameraCommandType type;
+    Vec3 v;
+    float yaw;
+    float pitch;
+    float amt;
+} CameraCommand;
+
+// Each worker counts into its own slot, padded so that no two share a cache line
+typedef struct WorkerCounters
+{
+    CancelStats cancelStats;
+    Stats stats;
+    char padding[64];
+} WorkerCounters;
+
+// Slot index of a published buffer the UI thread has not picked up yet
+#define PUBLISHED_FRESH 4
+
+#define DEFAULT_MAX_SAMPLES 64
 
 struct RayTracingEngine
 {
@@ -12,13 +49,71 @@ struct RayTracingEngine
     int *blockOrder;
     int blockOrderIndex;
     int blockOrderVal;
+    int maxSamples;
+    int runSample;
+    int rowsPerPass;
+    int passesPerSimulate;
+    int *spans;
+    int spanCount;
+    uint8_t *spanDone;
+    int64_t deadline;
+    _Atomic unsigned epoch;
+    unsigned runEpoch;
+    WorkerCounters *workerCounters;
+    CancelStats cancelStats;
+    RayCounts rayCounts;
+    // Filled in by the simulate call in progress, then published to lastStats for RayTracingEngine_getStats
+    SimulateStats runStats;
+    int64_t runStart;
+    SimulateStats lastStats;
     Framebuffer *renderBuffer;
+    HdrBuffer *hdrBuffer;
+    WorkerPool *pool;
 
     Scene *scene;
     Camera *camera;
+
+    // Reprojection: depth of every pixel as seen from depthCamera, NAN where nothing has been traced or warped yet
+    int reprojectionEnabled;
+    Camera *depthCamera;
+    float *depthBuffer;
+    float *warpDepth;
+    uint8_t *warpPixels;
+    int *holes;
+    int holeCount;
+
+    // Wavefront mode: a pass is traced a stage at a time over all its rays, which are generated into passRays first
+    int wavefrontEnabled;
+    Wavefront *wavefront;
+    Vec3 *passRays;
+    int *passPixels;
+    int passSpanFirst;
+    int passRayCount;
+
+    // Heatmap mode: the summed cost of every sample traced into each pixel since the last restart
+    HeatmapMode heatmapMode;
+    float *heat;
+
+    // Asynchronous mode: the render thread owns renderBuffer and hands copies to the UI through publishBuffers
+    Thread *renderThread;
+    int asyncRunning;
+    int asyncQuit;
+    Mutex *commandMutex;
+    Condition *commandCondition;
+    CameraCommand *commands;
+    int commandsPtr;
+    int commandsSize;
+    CameraCommand *pendingCommands;
+    int pendingCommandsSize;
+    Framebuffer *publishBuffers[3];
+    DirtyRegion *publishedDirty;
+    _Atomic int publishedIndex;
+    int frontIndex;
+    int spareIndex;
 };
 
-RayTracingEngine *RayTracingEngine_create(int width, int height, int blockWidth, float fov)
+// threadCount below 1 uses every processor. passesPerSimulate is how many of the blockWidth^2 passes one simulate call traces.
+RayTracingEngine *RayTracingEngine_create(int width, int height, int blockWidth, float fov, int threadCount, int passesPerSimulate)
 {
     RayTracingEngine *engine = malloc(sizeof *engine);
     if (engine)
@@ -32,18 +127,81 @@ RayTracingEngine *RayTracingEngine_create(int width, int height, int blockWidth,
         engine->blockOrder = malloc(sizeof *engine->blockOrder * engine->blockSize);
         engine->blockOrderIndex = 0;
         engine->blockOrderVal = 0;
+        engine->maxSamples = DEFAULT_MAX_SAMPLES;
+        engine->runSample = 0;
+        engine->rowsPerPass = (height + blockWidth - 1) / blockWidth;
+        engine->passesPerSimulate = passesPerSimulate < 1 ? 1 : passesPerSimulate > engine->blockSize ? engine->blockSize : passesPerSimulate;
+        engine->spans = malloc(sizeof *engine->spans * engine->blockSize * engine->rowsPerPass);
+        engine->spanCount = 0;
+        engine->spanDone = calloc(engine->blockSize * engine->rowsPerPass, sizeof *engine->spanDone);
+        engine->deadline = 0;
+        atomic_init(&engine->epoch, 0);
+        engine->runEpoch = 0;
+        engine->cancelStats = (CancelStats) {0};
+        engine->rayCounts = (RayCounts) {0};
+        engine->runStats = (SimulateStats) {0};
+        engine->runStart = 0;
+        engine->lastStats = (SimulateStats) {0};
+
+        engine->renderThread = NULL;
+        engine->asyncRunning = 0;
+        engine->asyncQuit = 0;
+        engine->commandMutex = Mutex_create();
+        engine->commandCondition = Condition_create();
+        engine->commands = malloc(sizeof *engine->commands);
+        engine->commandsPtr = 0;
+        engine->commandsSize = 1;
+        engine->pendingCommands = NULL;
+        engine->pendingCommandsSize = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            engine->publishBuffers[i] = NULL;
+        }
+        engine->publishedDirty = DirtyRegion_create(width, height);
+        atomic_init(&engine->publishedIndex, 0);
+        engine->frontIndex = 1;
+        engine->spareIndex = 2;
 
         engine->renderBuffer = Framebuffer_create(width, height);
+        engine->hdrBuffer = HdrBuffer_create(width, height);
+        engine->pool = WorkerPool_create(threadCount);
+        engine->workerCounters = engine->pool ? calloc(WorkerPool_getThreadCount(engine->pool), sizeof *engine->workerCounters) : NULL;
 
         engine->scene = Scene_create();
         engine->camera = Camera_create(width, height, fov);
-        if (!engine->renderBuffer || !engine->scene || !engine->camera || !engine->blockOrder)
+
+        engine->reprojectionEnabled = 1;
+        engine->depthCamera = Camera_create(width, height, fov);
+        engine->depthBuffer = malloc(sizeof *engine->depthBuffer * width * height);
+        engine->warpDepth = malloc(sizeof *engine->warpDepth * width * height);
+        engine->warpPixels = malloc(width * height * 3);
+        engine->holes = malloc(sizeof *engine->holes * width * height);
+        engine->holeCount = 0;
+
+        engine->wavefrontEnabled = 0;
+        engine->wavefront = Wavefront_create();
+        int spanSize = (width + blockWidth - 1) / blockWidth;
+        engine->passRays = malloc(sizeof *engine->passRays * engine->rowsPerPass * spanSize);
+        engine->passPixels = malloc(sizeof *engine->passPixels * engine->rowsPerPass * spanSize);
+        engine->passSpanFirst = 0;
+        engine->passRayCount = 0;
+
+        engine->heatmapMode = HEATMAP_OFF;
+        engine->heat = calloc(width * height, sizeof *engine->heat);
+        if (!engine->renderBuffer || !engine->hdrBuffer || !engine->scene || !engine->camera || !engine->blockOrder || !engine->pool || !engine->workerCounters || !engine->spans || !engine->spanDone
+            || !engine->commandMutex || !engine->commandCondition || !engine->commands || !engine->publishedDirty
+            || !engine->depthCamera || !engine->depthBuffer || !engine->warpDepth || !engine->warpPixels || !engine->holes
+            || !engine->wavefront || !engine->passRays || !engine->passPixels || !engine->heat)
         {
             RayTracingEngine_destroy(engine);
             engine = NULL;
         }
         else
         {
+            for (int i = 0; i < width * height; i++)
+            {
+                engine->depthBuffer[i] = NAN;
+            }
             for (int i = 0; i < engine->blockSize; i++)
             {
                 engine->blockOrder[i] = i;
@@ -72,39 +230,571 @@ int RayTracingEngine_getHeight(RayTracingEngine *engine)
     return engine->height;
 }
 
-void RayTracingEngine_simulate(RayTracingEngine *engine)
+int RayTracingEngine_getThreadCount(RayTracingEngine *engine)
+{
+    return WorkerPool_getThreadCount(engine->pool);
+}
+
+static int RayTracingEngine_spanPixels(RayTracingEngine *engine, int blockVal)
+{
+    return (engine->width - blockVal % engine->blockWidth + engine->blockWidth - 1) / engine->blockWidth;
+}
+
+// Rays of a span are generated this many at a time
+#define SPAN_CHUNK 64
+
+// 2^-24, turns the top 24 bits of a hash into a float in [0, 1)
+#define JITTER_SCALE (1.0f / 16777216.0f)
+
+// Integer hash that places the jittered samples, so the same pixel and sample always land on the same point
+static uint32_t RayTracingEngine_hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint8_t RayTracingEngine_toByte(float c)
+{
+    if (c > 1.0f) c = 1.0f;
+    return (uint8_t) floor(c * 255.0f + 0.5f);
+}
+
+// Adds a traced sample to pixel (x, y) and writes the pixel's new average
+static inline void RayTracingEngine_storeSample(RayTracingEngine *engine, uint8_t *pixels, int x, int y, Vec3 sample)
+{
+    int64_t statsStart = Stats_begin();
+    int pixel = y * engine->width + x;
+    Vec3 color = HdrBuffer_addSample(engine->hdrBuffer, x, y, sample);
+
+    pixels[pixel * 3    ] = RayTracingEngine_toByte(color.x);
+    pixels[pixel * 3 + 1] = RayTracingEngine_toByte(color.y);
+    pixels[pixel * 3 + 2] = RayTracingEngine_toByte(color.z);
+    Stats_end(STAT_TIMER_FRAMEBUFFER, statsStart);
+}
+
+static int64_t RayTracingEngine_heatCounter(RayTracingEngine *engine)
+{
+    return engine->heatmapMode == HEATMAP_TICKS ? Timer_getTicks() : Stats_get(STAT_PRIMITIVE_TESTS);
+}
+
+// Adds a sample of pixel (x, y) along rayDir. The first sample goes through the pixel center and also records the depth.
+static inline void RayTracingEngine_tracePixel(RayTracingEngine *engine, uint8_t *pixels, Vec3 camPos, Vec3 rayDir, int x, int y, int sample)
+{
+    float *depth = sample == 0 ? &engine->depthBuffer[y * engine->width + x] : NULL;
+    if (engine->heatmapMode == HEATMAP_OFF)
+    {
+        RayTracingEngine_storeSample(engine, pixels, x, y, Scene_trace(engine->scene, camPos, rayDir, depth));
+    }
+    else
+    {
+        // Only the trace itself is measured
+        int64_t start = RayTracingEngine_heatCounter(engine);
+        Vec3 color = Scene_trace(engine->scene, camPos, rayDir, depth);
+        engine->heat[y * engine->width + x] += RayTracingEngine_heatCounter(engine) - start;
+        RayTracingEngine_storeSample(engine, pixels, x, y, color);
+    }
+}
+
+// Ray through the jittered point of pixel (x, y) for a sample after the first, rowHash is the hash of the row and sample
+static Vec3 RayTracingEngine_jitteredRay(RayTracingEngine *engine, int x, int y, uint32_t rowHash)
 {
+    uint32_t hash = RayTracingEngine_hash(x + rowHash);
+    float jitterX = (hash >> 8) * JITTER_SCALE;
+    float jitterY = (RayTracingEngine_hash(hash) >> 8) * JITTER_SCALE;
+    return Camera_vectorAtPoint(engine->camera, x + jitterX, y + jitterY);
+}
+
+/*
+    Traces the pixels of row y that belong to the block pass blockVal. Sample 0 goes through the pixel
+    centers, later samples through a jittered point of each pixel. Every sample is added to the HDR buffer
+    and the pixel's new average is written to the render buffer. Pixels that already have the sample, because
+    the hole pass got to them first, are skipped. Stops early and returns the number of pixels visited once
+    the epoch moves on.
+*/
+static int RayTracingEngine_traceSpan(RayTracingEngine *engine, int blockVal, int y, int sample, unsigned epoch)
+{
+    uint8_t *pixels = Framebuffer_getPixels(engine->renderBuffer);
+    Vec3 camPos = Camera_getPos(engine->camera);
+
+    int blockPxOffset = blockVal % engine->blockWidth;
+
+    int spanPixels = RayTracingEngine_spanPixels(engine, blockVal);
+    Vec3 rayDirs[SPAN_CHUNK];
+    uint32_t rowHash = RayTracingEngine_hash(y + RayTracingEngine_hash(sample));
+
+    int traced = 0;
+    for (int x = blockPxOffset; x < engine->width; x += engine->blockWidth, traced++)
+    {
+        if (atomic_load_explicit(&engine->epoch, memory_order_relaxed) != epoch)
+            break;
+
+        Vec3 rayDir;
+        if (sample == 0)
+        {
+            int chunkIndex = traced % SPAN_CHUNK;
+            if (chunkIndex == 0)
+            {
+                int chunkPixels = spanPixels - traced < SPAN_CHUNK ? spanPixels - traced : SPAN_CHUNK;
+                Camera_rowVectors(engine->camera, y, x, engine->blockWidth, chunkPixels, rayDirs, Scene_getCpuLevel(engine->scene));
+            }
+            rayDir = rayDirs[chunkIndex];
+            if (HdrBuffer_getSampleCount(engine->hdrBuffer, x, y) > 0)
+                continue;
+        }
+        else
+        {
+            rayDir = RayTracingEngine_jitteredRay(engine, x, y, rowHash);
+        }
+
+        RayTracingEngine_tracePixel(engine, pixels, camPos, rayDir, x, y, sample);
+    }
+    return traced;
+}
+
+// Holes are traced this many to a task
+#define HOLE_CHUNK 256
+
+static void RayTracingEngine_holeTask(int taskIndex, int workerIndex, void *data)
+{
+    RayTracingEngine *engine = (RayTracingEngine*) data;
+
+    if (engine->deadline != 0 && Timer_getMicroseconds() >= engine->deadline)
+        return;
+
     uint8_t *pixels = Framebuffer_getPixels(engine->renderBuffer);
     Vec3 camPos = Camera_getPos(engine->camera);
+    int end = (taskIndex + 1) * HOLE_CHUNK < engine->holeCount ? (taskIndex + 1) * HOLE_CHUNK : engine->holeCount;
+    for (int i = taskIndex * HOLE_CHUNK; i < end; i++)
+    {
+        if (atomic_load_explicit(&engine->epoch, memory_order_relaxed) != engine->runEpoch)
+            break;
+
+        // The regular pass may have reached it since the list was last pruned
+        int x = engine->holes[i] % engine->width;
+        int y = engine->holes[i] / engine->width;
+        if (HdrBuffer_getSampleCount(engine->hdrBuffer, x, y) == 0)
+            RayTracingEngine_tracePixel(engine, pixels, camPos, Camera_vectorAt(engine->camera, x, y), x, y, 0);
+    }
+    Stats_take(&engine->workerCounters[workerIndex].stats);
+}
 
-    if (engine->blockOrderIndex < engine->blockSize)
+/*
+    Traces up to maxPixels of the pixels reprojection could not fill, ahead of the regular passes. Each gets
+    its first sample exactly as its pass would have traced it, so the pass skips it later and the image comes
+    out the same as without reprojection.
+*/
+static void RayTracingEngine_traceHoles(RayTracingEngine *engine, int maxPixels)
+{
+    int holeCount = engine->holeCount;
+    engine->holeCount = holeCount < maxPixels ? holeCount : maxPixels;
+    WorkerPool_run(engine->pool, (engine->holeCount + HOLE_CHUNK - 1) / HOLE_CHUNK, RayTracingEngine_holeTask, engine);
+    engine->holeCount = holeCount;
+
+    // Keep the holes that are still missing their sample, in order
+    DirtyRegion *dirty = Framebuffer_getDirtyRegion(engine->renderBuffer);
+    int remaining = 0;
+    for (int i = 0; i < holeCount; i++)
     {
-        engine->blockOrderVal = engine->blockOrder[engine->blockOrderIndex++];
-        int blockPxOffset = engine->blockOrderVal % engine->blockWidth;
-        int blockPyOffset = engine->blockOrderVal / engine->blockWidth;
+        int x = engine->holes[i] % engine->width;
+        int y = engine->holes[i] / engine->width;
+        if (HdrBuffer_getSampleCount(engine->hdrBuffer, x, y) == 0)
+        {
+            engine->holes[remaining++] = engine->holes[i];
+        }
+        else
+        {
+            DirtyRegion_markRow(dirty, y, x, x);
+        }
+    }
+    engine->holeCount = remaining;
+}
 
-        int pLocIncColumn = engine->blockWidth * 3;
+/*
+    A span is one row of one pass, numbered pass * rowsPerPass + row. Spans never share pixels, so workers
+    write the framebuffer without locks. spanDone remembers which spans of the current round of blockSize
+    passes are finished, which lets a pass that ran out of time be resumed by the next simulate call. A task
+    traces span passSpanFirst + taskIndex of the list runPasses collected.
+*/
+static void RayTracingEngine_spanTask(int taskIndex, int workerIndex, void *data)
+{
+    RayTracingEngine *engine = (RayTracingEngine*) data;
+
+    if (engine->deadline != 0 && Timer_getMicroseconds() >= engine->deadline)
+        return;
+
+    int span = engine->spans[engine->passSpanFirst + taskIndex];
+    int blockVal = engine->blockOrder[span / engine->rowsPerPass];
+    int y = blockVal / engine->blockWidth + (span % engine->rowsPerPass) * engine->blockWidth;
+    if (y < engine->height)
+    {
+        // A span cut short by a camera move stays unfinished, the restart that follows clears whatever it wrote
+        int spanPixels = RayTracingEngine_spanPixels(engine, blockVal);
+        int traced = RayTracingEngine_traceSpan(engine, blockVal, y, engine->runSample, engine->runEpoch);
+        Stats_take(&engine->workerCounters[workerIndex].stats);
+        if (traced < spanPixels)
+        {
+            CancelStats *stats = &engine->workerCounters[workerIndex].cancelStats;
+            stats->cancelledSpans++;
+            stats->skippedPixels += spanPixels - traced;
+            stats->discardedPixels += traced;
+            return;
+        }
+    }
+    engine->spanDone[span] = 1;
+}
+
+/*
+    Generates the rays of span passSpanFirst + taskIndex of a wavefront pass into its row of passRays, made the
+    same way traceSpan makes them. Entries that need no ray get a pixel of -1, either past the end of the span
+    or because the hole pass already gave the pixel its sample.
+*/
+static void RayTracingEngine_generateTask(int taskIndex, int workerIndex, void *data)
+{
+    RayTracingEngine *engine = (RayTracingEngine*) data;
+
+    int span = engine->spans[engine->passSpanFirst + taskIndex];
+    int blockVal = engine->blockOrder[span / engine->rowsPerPass];
+    int y = blockVal / engine->blockWidth + (span % engine->rowsPerPass) * engine->blockWidth;
+    int rowSize = RayTracingEngine_spanPixels(engine, 0);
+    Vec3 *rays = engine->passRays + taskIndex * rowSize;
+    int *pixels = engine->passPixels + taskIndex * rowSize;
 
-        for (int y = blockPyOffset; y < engine->height; y += engine->blockWidth)
+    int spanPixels = y < engine->height ? RayTracingEngine_spanPixels(engine, blockVal) : 0;
+    int sample = engine->runSample;
+    uint32_t rowHash = RayTracingEngine_hash(y + RayTracingEngine_hash(sample));
+    for (int i = 0; i < spanPixels; i++)
+    {
+        int x = blockVal % engine->blockWidth + i * engine->blockWidth;
+        if (sample == 0)
         {
-            int pLoc = (y * engine->width + blockPxOffset) * 3;
-            for (int x = blockPxOffset; x < engine->width; x += engine->blockWidth, pLoc += pLocIncColumn)
+            if (i % SPAN_CHUNK == 0)
             {
-                Vec3 rayDir = Camera_vectorAt(engine->camera, x, y);
+                int chunkPixels = spanPixels - i < SPAN_CHUNK ? spanPixels - i : SPAN_CHUNK;
+                Camera_rowVectors(engine->camera, y, x, engine->blockWidth, chunkPixels, rays + i, Scene_getCpuLevel(engine->scene));
+            }
+            pixels[i] = HdrBuffer_getSampleCount(engine->hdrBuffer, x, y) > 0 ? -1 : y * engine->width + x;
+        }
+        else
+        {
+            rays[i] = RayTracingEngine_jitteredRay(engine, x, y, rowHash);
+            pixels[i] = y * engine->width + x;
+        }
+    }
+    for (int i = spanPixels; i < rowSize; i++)
+    {
+        pixels[i] = -1;
+    }
+}
+
+// Pixels of a wavefront pass are stored this many to a task
+#define STORE_CHUNK 256
+
+static void RayTracingEngine_storeTask(int taskIndex, int workerIndex, void *data)
+{
+    RayTracingEngine *engine = (RayTracingEngine*) data;
+
+    uint8_t *pixels = Framebuffer_getPixels(engine->renderBuffer);
+    int end = (taskIndex + 1) * STORE_CHUNK < engine->passRayCount ? (taskIndex + 1) * STORE_CHUNK : engine->passRayCount;
+    for (int ray = taskIndex * STORE_CHUNK; ray < end; ray++)
+    {
+        int pixel = engine->passPixels[ray];
+        if (engine->runSample == 0)
+        {
+            engine->depthBuffer[pixel] = Wavefront_getDepth(engine->wavefront, ray);
+        }
+        RayTracingEngine_storeSample(engine, pixels, pixel % engine->width, pixel / engine->width, Wavefront_getColor(engine->wavefront, ray));
+    }
+    Stats_take(&engine->workerCounters[workerIndex].stats);
+}
+
+/*
+    Traces the spans collected by runPasses with the wavefront tracer instead of a task per span. The spans
+    of one pass go through together: their rays are generated and compacted into one batch, the batch is
+    traced a stage at a time, and the results are stored just as traceSpan stores them, so the image is the
+    same. Cancellation and the deadline are checked between passes. A pass whose camera moved while it was
+    traced is thrown away whole.
+*/
+static void RayTracingEngine_runWavefront(RayTracingEngine *engine)
+{
+    Vec3 camPos = Camera_getPos(engine->camera);
+    int rowSize = RayTracingEngine_spanPixels(engine, 0);
+    // Stages run on the pool, everything else here runs on the calling thread, which counts into the first slot
+    WorkerCounters *counters = &engine->workerCounters[0];
+    CancelStats *stats = &counters->cancelStats;
+
+    int first = 0;
+    while (first < engine->spanCount)
+    {
+        int pass = engine->spans[first] / engine->rowsPerPass;
+        int last = first;
+        while (last < engine->spanCount && engine->spans[last] / engine->rowsPerPass == pass)
+        {
+            last++;
+        }
+        int spanPixels = RayTracingEngine_spanPixels(engine, engine->blockOrder[pass]);
 
-                Vec3 color = Scene_trace(engine->scene, camPos, rayDir);
-                uint8_t r = (uint8_t) floor(color.x * 255.0f + 0.5f);
-                uint8_t g = (uint8_t) floor(color.y * 255.0f + 0.5f);
-                uint8_t b = (uint8_t) floor(color.z * 255.0f + 0.5f);
+        if (engine->deadline != 0 && Timer_getMicroseconds() >= engine->deadline)
+            break;
+        if (atomic_load_explicit(&engine->epoch, memory_order_relaxed) != engine->runEpoch)
+        {
+            stats->cancelledSpans += last - first;
+            stats->skippedPixels += (int64_t) (last - first) * spanPixels;
+            first = last;
+            continue;
+        }
 
-                pixels[pLoc    ] = r;
-                pixels[pLoc + 1] = g;
-                pixels[pLoc + 2] = b;
+        engine->passSpanFirst = first;
+        if (!Wavefront_begin(engine->wavefront, (last - first) * rowSize))
+        {
+            // Without room for the batch the pass is traced depth first, a task per span
+            WorkerPool_run(engine->pool, last - first, RayTracingEngine_spanTask, engine);
+            first = last;
+            continue;
+        }
+
+        WorkerPool_run(engine->pool, last - first, RayTracingEngine_generateTask, engine);
+        engine->passRayCount = 0;
+        for (int i = 0; i < (last - first) * rowSize; i++)
+        {
+            if (engine->passPixels[i] >= 0)
+            {
+                engine->passPixels[engine->passRayCount++] = engine->passPixels[i];
+                Wavefront_addRay(engine->wavefront, camPos, engine->passRays[i]);
             }
         }
+        Wavefront_trace(engine->wavefront, engine->scene, engine->pool);
+        Wavefront_takeStats(engine->wavefront, &counters->stats);
+
+        if (atomic_load_explicit(&engine->epoch, memory_order_relaxed) != engine->runEpoch)
+        {
+            stats->cancelledSpans += last - first;
+            stats->discardedPixels += (int64_t) (last - first) * spanPixels;
+            first = last;
+            continue;
+        }
+
+        WorkerPool_run(engine->pool, (engine->passRayCount + STORE_CHUNK - 1) / STORE_CHUNK, RayTracingEngine_storeTask, engine);
+        for (int i = first; i < last; i++)
+        {
+            engine->spanDone[engine->spans[i]] = 1;
+        }
+        first = last;
+    }
+}
+
+// Rays are counted with the profiling stats, so the counts stay at zero unless built with RT_STATS
+static void RayTracingEngine_addRayCounts(RayCounts *counts, const Stats *stats)
+{
+    counts->primary += stats->counters[STAT_PRIMARY_RAYS];
+    counts->shadow += stats->counters[STAT_SHADOW_RAYS];
+    counts->reflection += stats->counters[STAT_REFLECTION_RAYS];
+}
+
+/*
+    Traces the unfinished spans of the next passCount passes for the camera of the given epoch and returns
+    the number of pixels traced. Passes come in rounds of blockSize that each add one sample to every pixel,
+    round n traces sample n. A call never runs past the end of the current round.
+*/
+static int RayTracingEngine_runPasses(RayTracingEngine *engine, int passCount, unsigned epoch)
+{
+    int roundStart = engine->blockOrderIndex - engine->blockOrderIndex % engine->blockSize;
+    int passEnd = engine->blockOrderIndex + passCount;
+    if (passEnd > roundStart + engine->blockSize)
+    {
+        passEnd = roundStart + engine->blockSize;
+    }
+
+    engine->spanCount = 0;
+    for (int span = (engine->blockOrderIndex - roundStart) * engine->rowsPerPass; span < (passEnd - roundStart) * engine->rowsPerPass; span++)
+    {
+        if (!engine->spanDone[span])
+        {
+            engine->spans[engine->spanCount++] = span;
+        }
+    }
+
+    Scene_update(engine->scene);
+    engine->runEpoch = epoch;
+    engine->runSample = roundStart / engine->blockSize;
+
+    // Holes left by reprojection go first, at most as many pixels as the passes themselves cover
+    if (engine->holeCount > 0)
+    {
+        RayTracingEngine_traceHoles(engine, (passEnd - engine->blockOrderIndex) * engine->rowsPerPass * RayTracingEngine_spanPixels(engine, 0));
+    }
+
+    // The wavefront tracer works on whole batches, which leaves nothing to measure a single pixel by
+    if (engine->wavefrontEnabled && engine->heatmapMode == HEATMAP_OFF)
+    {
+        RayTracingEngine_runWavefront(engine);
+    }
+    else
+    {
+        engine->passSpanFirst = 0;
+        WorkerPool_run(engine->pool, engine->spanCount, RayTracingEngine_spanTask, engine);
+    }
+
+    Mutex_lock(engine->commandMutex);
+    for (int i = 0; i < WorkerPool_getThreadCount(engine->pool); i++)
+    {
+        CancelStats *stats = &engine->workerCounters[i].cancelStats;
+        engine->cancelStats.cancelledSpans += stats->cancelledSpans;
+        engine->cancelStats.skippedPixels += stats->skippedPixels;
+        engine->cancelStats.discardedPixels += stats->discardedPixels;
+        *stats = (CancelStats) {0};
+
+        Stats *workerStats = &engine->workerCounters[i].stats;
+        RayTracingEngine_addRayCounts(&engine->rayCounts, workerStats);
+        RayTracingEngine_addRayCounts(&engine->runStats.rays, workerStats);
+        Stats_add(&engine->runStats.profile, workerStats);
+        *workerStats = (Stats) {0};
+    }
+    Mutex_unlock(engine->commandMutex);
+
+    // Partly traced spans are not marked, they only exist when the camera moved and the restart marks everything
+    int pixelsTraced = 0;
+    for (int i = 0; i < engine->spanCount; i++)
+    {
+        int span = engine->spans[i];
+        int blockVal = engine->blockOrder[span / engine->rowsPerPass];
+        int y = blockVal / engine->blockWidth + (span % engine->rowsPerPass) * engine->blockWidth;
+        if (engine->spanDone[span] && y < engine->height)
+        {
+            int spanPixels = RayTracingEngine_spanPixels(engine, blockVal);
+            int xMin = blockVal % engine->blockWidth;
+            DirtyRegion_markRow(Framebuffer_getDirtyRegion(engine->renderBuffer), y, xMin, xMin + (spanPixels - 1) * engine->blockWidth);
+            pixelsTraced += spanPixels;
+        }
+    }
+
+    while (engine->blockOrderIndex < passEnd)
+    {
+        uint8_t *passDone = &engine->spanDone[(engine->blockOrderIndex - roundStart) * engine->rowsPerPass];
+        int row = 0;
+        while (row < engine->rowsPerPass && passDone[row])
+        {
+            row++;
+        }
+        if (row < engine->rowsPerPass)
+            break;
+
+        engine->blockOrderVal = engine->blockOrder[engine->blockOrderIndex++ - roundStart];
+    }
+    if (engine->blockOrderIndex == roundStart + engine->blockSize)
+    {
+        memset(engine->spanDone, 0, engine->blockSize * engine->rowsPerPass);
+    }
+
+    engine->runStats.pixels += pixelsTraced;
+    return pixelsTraced;
+}
+
+static void RayTracingEngine_beginStats(RayTracingEngine *engine)
+{
+    engine->runStats = (SimulateStats) {0};
+    engine->runStart = Timer_getMicroseconds();
+}
+
+static void RayTracingEngine_endStats(RayTracingEngine *engine)
+{
+    engine->runStats.microseconds = Timer_getMicroseconds() - engine->runStart;
+    Mutex_lock(engine->commandMutex);
+    engine->lastStats = engine->runStats;
+    Mutex_unlock(engine->commandMutex);
+}
+
+// Number of passes after which every pixel has maxSamples samples and the image stops changing
+static int RayTracingEngine_passLimit(RayTracingEngine *engine)
+{
+    return engine->blockSize * engine->maxSamples;
+}
+
+void RayTracingEngine_simulate(RayTracingEngine *engine)
+{
+    if (engine->blockOrderIndex < RayTracingEngine_passLimit(engine))
+    {
+        RayTracingEngine_beginStats(engine);
+        RayTracingEngine_runPasses(engine, engine->passesPerSimulate, atomic_load(&engine->epoch));
+        RayTracingEngine_endStats(engine);
+    }
+}
+
+// Keeps tracing passes, resuming unfinished ones row by row, until the time budget is spent. Returns the number of pixels traced.
+int RayTracingEngine_simulateFor(RayTracingEngine *engine, int64_t microseconds)
+{
+    int pixelsTraced = 0;
+    RayTracingEngine_beginStats(engine);
+    engine->deadline = Timer_getMicroseconds() + microseconds;
+    while (engine->blockOrderIndex < RayTracingEngine_passLimit(engine) && Timer_getMicroseconds() < engine->deadline)
+    {
+        pixelsTraced += RayTracingEngine_runPasses(engine, 1, atomic_load(&engine->epoch));
     }
+    engine->deadline = 0;
+    RayTracingEngine_endStats(engine);
+
+    return pixelsTraced;
+}
+
+// Only meaningful when tracing synchronously, the render thread owns the progress while async
+int RayTracingEngine_isComplete(RayTracingEngine *engine)
+{
+    return engine->blockOrderIndex >= RayTracingEngine_passLimit(engine);
+}
+
+// stats must have room for RayTracingEngine_getThreadCount entries
+void RayTracingEngine_getWorkerStats(RayTracingEngine *engine, WorkerStats stats[])
+{
+    WorkerPool_getStats(engine->pool, stats);
+}
+
+void RayTracingEngine_resetWorkerStats(RayTracingEngine *engine)
+{
+    WorkerPool_resetStats(engine->pool);
+}
+
+// Totals since the last reset of ray work dropped because the camera moved while it was being traced
+void RayTracingEngine_getCancelStats(RayTracingEngine *engine, CancelStats *stats)
+{
+    Mutex_lock(engine->commandMutex);
+    *stats = engine->cancelStats;
+    Mutex_unlock(engine->commandMutex);
+}
+
+void RayTracingEngine_resetCancelStats(RayTracingEngine *engine)
+{
+    Mutex_lock(engine->commandMutex);
+    engine->cancelStats = (CancelStats) {0};
+    Mutex_unlock(engine->commandMutex);
+}
+
+// Totals since the last reset of the rays traced, including any that were thrown away after a camera move. Needs RT_STATS.
+void RayTracingEngine_getRayCounts(RayTracingEngine *engine, RayCounts *counts)
+{
+    Mutex_lock(engine->commandMutex);
+    *counts = engine->rayCounts;
+    Mutex_unlock(engine->commandMutex);
+}
+
+void RayTracingEngine_resetRayCounts(RayTracingEngine *engine)
+{
+    Mutex_lock(engine->commandMutex);
+    engine->rayCounts = (RayCounts) {0};
+    Mutex_unlock(engine->commandMutex);
+}
+
+// Work done by the latest simulate or simulateFor call, or while async by the render thread's latest batch of passes
+void RayTracingEngine_getStats(RayTracingEngine *engine, SimulateStats *stats)
+{
+    Mutex_lock(engine->commandMutex);
+    *stats = engine->lastStats;
+    Mutex_unlock(engine->commandMutex);
 }
 
+// The buffer the engine traces into. In asynchronous mode it belongs to the render thread, use RayTracingEngine_getFrontBuffer instead.
 Framebuffer *RayTracingEngine_getRenderBuffer(RayTracingEngine *engine)
 {
     return engine->renderBuffer;
@@ -115,41 +805,490 @@ Scene *RayTracingEngine_getScene(RayTracingEngine *engine)
     return engine->scene;
 }
 
-void RayTracingEngine_moveCamera(RayTracingEngine *engine, Vec3 v, float yaw, float pitch)
+// Once the first round has covered every pixel the engine keeps refining the image with jittered samples until each pixel has maxSamples
+void RayTracingEngine_setMaxSamples(RayTracingEngine *engine, int maxSamples)
+{
+    Mutex_lock(engine->commandMutex);
+    engine->maxSamples = maxSamples < 1 ? 1 : maxSamples > UINT16_MAX ? UINT16_MAX : maxSamples;
+    Condition_signal(engine->commandCondition);
+    Mutex_unlock(engine->commandMutex);
+}
+
+/*
+    Warps the image seen from depthCamera into the view of the current camera. Every pixel with a depth is
+    turned back into the point it showed and moved to the pixel that point lands on now, the nearest point
+    winning where several land on one pixel. Pixels with infinite depth showed the sky, they move by
+    direction alone. Pixels nothing lands on become holes.
+*/
+static void RayTracingEngine_reproject(RayTracingEngine *engine)
+{
+    int width = engine->width;
+    int height = engine->height;
+    uint8_t *pixels = Framebuffer_getPixels(engine->renderBuffer);
+    Vec3 oldPos = Camera_getPos(engine->depthCamera);
+    Vec3 newPos = Camera_getPos(engine->camera);
+
+    memset(engine->warpPixels, 0, width * height * 3);
+    for (int i = 0; i < width * height; i++)
+    {
+        engine->warpDepth[i] = NAN;
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            int pixel = y * width + x;
+            float depth = engine->depthBuffer[pixel];
+            if (isnan(depth))
+                continue;
+
+            Vec3 dir = Camera_vectorAt(engine->depthCamera, x, y);
+            float newDepth = INFINITY;
+            if (!isinf(depth))
+            {
+                dir = Vec3_sub(Vec3_add(oldPos, Vec3_mulScalar(dir, depth)), newPos);
+                newDepth = Vec3_len(dir);
+            }
+
+            float px, py;
+            if (!Camera_project(engine->camera, dir, &px, &py) || !(px >= 0.0f && px < width && py >= 0.0f && py < height))
+                continue;
+
+            int target = (int) py * width + (int) px;
+            if (isnan(engine->warpDepth[target]) || newDepth < engine->warpDepth[target])
+            {
+                engine->warpDepth[target] = newDepth;
+                memcpy(&engine->warpPixels[target * 3], &pixels[pixel * 3], 3);
+            }
+        }
+    }
+
+    memcpy(pixels, engine->warpPixels, width * height * 3);
+    float *depth = engine->depthBuffer;
+    engine->depthBuffer = engine->warpDepth;
+    engine->warpDepth = depth;
+
+    engine->holeCount = 0;
+    for (int i = 0; i < width * height; i++)
+    {
+        if (isnan(engine->depthBuffer[i]))
+        {
+            engine->holes[engine->holeCount++] = i;
+        }
+    }
+    DirtyRegion_markAll(Framebuffer_getDirtyRegion(engine->renderBuffer));
+}
+
+// Starts over after the camera moved, from the reprojected old image if enabled
+static void RayTracingEngine_restart(RayTracingEngine *engine)
 {
-    Camera_move(engine->camera, v, yaw, pitch);
-    Framebuffer_clear(engine->renderBuffer, 0, 0, 0);
+    if (engine->reprojectionEnabled)
+    {
+        RayTracingEngine_reproject(engine);
+    }
+    else
+    {
+        Framebuffer_clear(engine->renderBuffer, 0, 0, 0);
+        for (int i = 0; i < engine->width * engine->height; i++)
+        {
+            engine->depthBuffer[i] = NAN;
+        }
+        engine->holeCount = 0;
+    }
+    Camera_copy(engine->depthCamera, engine->camera);
+    HdrBuffer_clear(engine->hdrBuffer);
+    memset(engine->heat, 0, sizeof *engine->heat * engine->width * engine->height);
+    memset(engine->spanDone, 0, engine->blockSize * engine->rowsPerPass);
     engine->blockOrderIndex = 0;
 }
 
+// Reprojection is on by default. Only call this while tracing synchronously.
+void RayTracingEngine_setReprojectionEnabled(RayTracingEngine *engine, int enabled)
+{
+    engine->reprojectionEnabled = enabled;
+}
+
+// Traces each pass with the wavefront tracer, off by default. Only call this while tracing synchronously.
+void RayTracingEngine_setWavefrontEnabled(RayTracingEngine *engine, int enabled)
+{
+    engine->wavefrontEnabled = enabled;
+}
+
+/*
+    Measures what every sample costs to trace, in the units of Timer_getTicks or in ray-primitive intersection
+    tests. Tests are counted with the profiling stats, so without RT_STATS HEATMAP_PRIMITIVE_TESTS is refused
+    and 0 returned, leaving the mode as it was. The image starts over so that the costs cover all of it. Passes
+    are then traced a span at a time even with the wavefront tracer enabled. Only call this while tracing
+    synchronously.
+*/
+int RayTracingEngine_setHeatmapMode(RayTracingEngine *engine, HeatmapMode mode)
+{
+    if (mode == HEATMAP_PRIMITIVE_TESTS && !STATS_ENABLED)
+        return 0;
+
+    engine->heatmapMode = mode;
+    RayTracingEngine_restart(engine);
+    return 1;
+}
+
+static float RayTracingEngine_pixelCost(RayTracingEngine *engine, int x, int y)
+{
+    int samples = HdrBuffer_getSampleCount(engine->hdrBuffer, x, y);
+    return samples > 0 ? engine->heat[y * engine->width + x] / samples : 0.0f;
+}
+
+// Fills costs, which must have room for width * height values, with each pixel's average cost per sample. Returns the largest.
+float RayTracingEngine_getHeatmap(RayTracingEngine *engine, float costs[])
+{
+    float maxCost = 0.0f;
+    for (int y = 0; y < engine->height; y++)
+    {
+        for (int x = 0; x < engine->width; x++)
+        {
+            int pixel = y * engine->width + x;
+            costs[pixel] = RayTracingEngine_pixelCost(engine, x, y);
+            maxCost = costs[pixel] > maxCost ? costs[pixel] : maxCost;
+        }
+    }
+    return maxCost;
+}
+
+#define HEATMAP_SATURATED 0.01f
+
+// Black for no cost, then through blue, cyan, green and yellow to red for the most expensive pixel
+static void RayTracingEngine_heatColor(float v, uint8_t *rgb)
+{
+    static const float ramp[6][3] = {{0, 0, 0}, {0, 0, 255}, {0, 255, 255}, {0, 255, 0}, {255, 255, 0}, {255, 0, 0}};
+    float f = (v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v) * 5.0f;
+    int i = f >= 5.0f ? 4 : (int) f;
+    float t = f - i;
+    for (int c = 0; c < 3; c++)
+    {
+        rgb[c] = (uint8_t) (ramp[i][c] + (ramp[i + 1][c] - ramp[i][c]) * t + 0.5f);
+    }
+}
+
+static int RayTracingEngine_compareCosts(const void *a, const void *b)
+{
+    float x = *(const float*) a;
+    float y = *(const float*) b;
+    return (x > y) - (x < y);
+}
+
+/*
+    Draws the average cost per sample of every pixel in false color. dest must be the engine's size. The
+    colors are scaled so that the costliest HEATMAP_SATURATED of the pixels show as red, which keeps a few
+    outliers, such as samples whose thread was preempted, from washing out the rest.
+*/
+void RayTracingEngine_renderHeatmap(RayTracingEngine *engine, Framebuffer *dest)
+{
+    int pixelCount = engine->width * engine->height;
+    float *costs = malloc(sizeof *costs * pixelCount);
+    float fullCost = 0.0f;
+    if (costs)
+    {
+        RayTracingEngine_getHeatmap(engine, costs);
+        qsort(costs, pixelCount, sizeof *costs, RayTracingEngine_compareCosts);
+        fullCost = costs[(int) ((pixelCount - 1) * (1.0f - HEATMAP_SATURATED))];
+        free(costs);
+    }
+
+    uint8_t *pixels = Framebuffer_getPixels(dest);
+    float scale = fullCost > 0.0f ? 1.0f / fullCost : 0.0f;
+    for (int y = 0; y < engine->height; y++)
+    {
+        for (int x = 0; x < engine->width; x++)
+        {
+            RayTracingEngine_heatColor(RayTracingEngine_pixelCost(engine, x, y) * scale, &pixels[(y * engine->width + x) * 3]);
+        }
+    }
+    DirtyRegion_markAll(Framebuffer_getDirtyRegion(dest));
+}
+
+static void RayTracingEngine_applyCommand(RayTracingEngine *engine, CameraCommand *command)
+{
+    switch (command->type)
+    {
+    case CAMERA_MOVE:
+        Camera_move(engine->camera, command->v, command->yaw, command->pitch);
+        break;
+    case CAMERA_MOVE_FORWARD:
+        Camera_moveForward(engine->camera, command->amt);
+        break;
+    case CAMERA_MOVE_UP:
+        Camera_moveUp(engine->camera, command->amt);
+        break;
+    case CAMERA_MOVE_RIGHT:
+        Camera_moveRight(engine->camera, command->amt);
+        break;
+    }
+}
+
+// Applies the command right away, or queues it for the render thread in asynchronous mode
+static void RayTracingEngine_submitCommand(RayTracingEngine *engine, CameraCommand command)
+{
+    if (!engine->asyncRunning)
+    {
+        RayTracingEngine_applyCommand(engine, &command);
+        RayTracingEngine_restart(engine);
+        return;
+    }
+
+    // Workers see the new epoch and abandon the view being traced within a pixel
+    Mutex_lock(engine->commandMutex);
+    atomic_fetch_add(&engine->epoch, 1);
+    int canAdd = 1;
+    if (engine->commandsPtr == engine->commandsSize)
+    {
+        int newSize = engine->commandsSize * 2;
+        CameraCommand *newArr = realloc(engine->commands, sizeof *newArr * newSize);
+        if (newArr)
+        {
+            engine->commands = newArr;
+            engine->commandsSize = newSize;
+        }
+        else
+        {
+            canAdd = 0;
+        }
+    }
+
+    if (canAdd)
+    {
+        engine->commands[engine->commandsPtr++] = command;
+        Condition_signal(engine->commandCondition);
+    }
+    Mutex_unlock(engine->commandMutex);
+}
+
+void RayTracingEngine_moveCamera(RayTracingEngine *engine, Vec3 v, float yaw, float pitch)
+{
+    RayTracingEngine_submitCommand(engine, (CameraCommand) {.type = CAMERA_MOVE, .v = v, .yaw = yaw, .pitch = pitch});
+}
+
 void RayTracingEngine_moveCameraForward(RayTracingEngine *engine, float amt)
 {
-    Camera_moveForward(engine->camera, amt);
-    Framebuffer_clear(engine->renderBuffer, 0, 0, 0);
-    engine->blockOrderIndex = 0;
+    RayTracingEngine_submitCommand(engine, (CameraCommand) {.type = CAMERA_MOVE_FORWARD, .amt = amt});
 }
 
 void RayTracingEngine_moveCameraUp(RayTracingEngine *engine, float amt)
 {
-    Camera_moveUp(engine->camera, amt);
-    Framebuffer_clear(engine->renderBuffer, 0, 0, 0);
-    engine->blockOrderIndex = 0;
+    RayTracingEngine_submitCommand(engine, (CameraCommand) {.type = CAMERA_MOVE_UP, .amt = amt});
 }
 
 void RayTracingEngine_moveCameraRight(RayTracingEngine *engine, float amt)
 {
+    RayTracingEngine_submitCommand(engine, (CameraCommand) {.type = CAMERA_MOVE_RIGHT, .amt = amt});
+}
 
-    Camera_moveRight(engine->camera, amt);
-    Framebuffer_clear(engine->renderBuffer, 0, 0, 0);
-    engine->blockOrderIndex = 0;
+/*
+    Copies the back buffer into the spare slot and swaps it with the published slot, the UI thread never waits
+    on this. A published buffer's dirty region covers everything that changed since the buffer the UI last
+    picked up, so the changes of a buffer that may be replaced before the UI got to it are carried over.
+    publishedDirty keeps them on the render thread's side, the UI thread is free to clear the published copy.
+*/
+static void RayTracingEngine_publish(RayTracingEngine *engine)
+{
+    Framebuffer *spare = engine->publishBuffers[engine->spareIndex];
+    DirtyRegion *changes = Framebuffer_getDirtyRegion(spare);
+    Framebuffer_copy(spare, engine->renderBuffer);
+    if (atomic_load(&engine->publishedIndex) & PUBLISHED_FRESH)
+    {
+        DirtyRegion_merge(changes, engine->publishedDirty);
+    }
+    DirtyRegion_copy(engine->publishedDirty, changes);
+    DirtyRegion_clear(Framebuffer_getDirtyRegion(engine->renderBuffer));
+
+    int previous = atomic_exchange(&engine->publishedIndex, engine->spareIndex | PUBLISHED_FRESH);
+    engine->spareIndex = previous & ~PUBLISHED_FRESH;
+}
+
+static void RayTracingEngine_renderLoop(void *data)
+{
+    RayTracingEngine *engine = (RayTracingEngine*) data;
+
+    Mutex_lock(engine->commandMutex);
+    while (1)
+    {
+        while (!engine->asyncQuit && engine->commandsPtr == 0 && engine->blockOrderIndex >= RayTracingEngine_passLimit(engine))
+        {
+            Condition_wait(engine->commandCondition, engine->commandMutex);
+        }
+        if (engine->asyncQuit)
+            break;
+
+        // Copy the queued commands out so the UI thread can keep queueing while they are applied
+        int commandCount = engine->commandsPtr;
+        if (commandCount > engine->pendingCommandsSize)
+        {
+            CameraCommand *newArr = realloc(engine->pendingCommands, sizeof *newArr * engine->commandsSize);
+            if (newArr)
+            {
+                engine->pendingCommands = newArr;
+                engine->pendingCommandsSize = engine->commandsSize;
+            }
+            else
+            {
+                commandCount = engine->pendingCommandsSize;
+            }
+        }
+        if (commandCount > 0)
+        {
+            memcpy(engine->pendingCommands, engine->commands, sizeof *engine->commands * commandCount);
+        }
+        engine->commandsPtr -= commandCount;
+        memmove(engine->commands, engine->commands + commandCount, sizeof *engine->commands * engine->commandsPtr);
+        unsigned epoch = atomic_load(&engine->epoch);
+        int passLimit = RayTracingEngine_passLimit(engine);
+        Mutex_unlock(engine->commandMutex);
+
+        // Commands are only applied here, between passes
+        for (int i = 0; i < commandCount; i++)
+        {
+            RayTracingEngine_applyCommand(engine, &engine->pendingCommands[i]);
+        }
+        if (commandCount > 0)
+        {
+            RayTracingEngine_restart(engine);
+        }
+
+        if (engine->blockOrderIndex < passLimit)
+        {
+            RayTracingEngine_beginStats(engine);
+            RayTracingEngine_runPasses(engine, engine->passesPerSimulate, epoch);
+            RayTracingEngine_endStats(engine);
+        }
+        // A cancelled pass is about to be cleared, there is no point showing it
+        if (atomic_load(&engine->epoch) == epoch)
+        {
+            RayTracingEngine_publish(engine);
+        }
+
+        Mutex_lock(engine->commandMutex);
+    }
+    Mutex_unlock(engine->commandMutex);
+}
+
+// Starts tracing on a dedicated render thread. Returns 0 if the thread or its buffers could not be created.
+int RayTracingEngine_startAsync(RayTracingEngine *engine)
+{
+    if (engine->asyncRunning)
+        return 1;
+
+    for (int i = 0; i < 3; i++)
+    {
+        engine->publishBuffers[i] = Framebuffer_create(engine->width, engine->height);
+        if (!engine->publishBuffers[i])
+        {
+            RayTracingEngine_stopAsync(engine);
+            return 0;
+        }
+        Framebuffer_copy(engine->publishBuffers[i], engine->renderBuffer);
+    }
+    DirtyRegion_copy(engine->publishedDirty, Framebuffer_getDirtyRegion(engine->renderBuffer));
+    atomic_store(&engine->publishedIndex, 0);
+    engine->frontIndex = 1;
+    engine->spareIndex = 2;
+
+    engine->asyncQuit = 0;
+    engine->asyncRunning = 1;
+    engine->renderThread = Thread_create(RayTracingEngine_renderLoop, engine);
+    if (!engine->renderThread)
+    {
+        RayTracingEngine_stopAsync(engine);
+        return 0;
+    }
+    return 1;
+}
+
+// Stops the render thread and applies any camera commands it had not picked up yet
+void RayTracingEngine_stopAsync(RayTracingEngine *engine)
+{
+    if (engine->renderThread)
+    {
+        Mutex_lock(engine->commandMutex);
+        engine->asyncQuit = 1;
+        Condition_signal(engine->commandCondition);
+        Mutex_unlock(engine->commandMutex);
+
+        Thread_join(engine->renderThread);
+        engine->renderThread = NULL;
+    }
+    engine->asyncRunning = 0;
+
+    if (engine->commandsPtr > 0)
+    {
+        for (int i = 0; i < engine->commandsPtr; i++)
+        {
+            RayTracingEngine_applyCommand(engine, &engine->commands[i]);
+        }
+        engine->commandsPtr = 0;
+        RayTracingEngine_restart(engine);
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (engine->publishBuffers[i])
+        {
+            Framebuffer_destroy(engine->publishBuffers[i]);
+            engine->publishBuffers[i] = NULL;
+        }
+    }
+}
+
+/*
+    The most recently finished image. In asynchronous mode this is a published copy that stays valid until the
+    next call. Its dirty region covers what changed since the image the caller last presented, provided the
+    caller clears it with DirtyRegion_clear after presenting.
+*/
+Framebuffer *RayTracingEngine_getFrontBuffer(RayTracingEngine *engine)
+{
+    if (!engine->asyncRunning)
+        return engine->renderBuffer;
+
+    if (atomic_load(&engine->publishedIndex) & PUBLISHED_FRESH)
+    {
+        engine->frontIndex = atomic_exchange(&engine->publishedIndex, engine->frontIndex) & ~PUBLISHED_FRESH;
+    }
+    return engine->publishBuffers[engine->frontIndex];
 }
 
 void RayTracingEngine_destroy(RayTracingEngine *engine)
 {
+    if (engine->commandMutex && engine->commandCondition)
+    {
+        RayTracingEngine_stopAsync(engine);
+    }
     Framebuffer_destroy(engine->renderBuffer);
+    HdrBuffer_destroy(engine->hdrBuffer);
     Scene_destroy(engine->scene);
     Camera_destroy(engine->camera);
+    Camera_destroy(engine->depthCamera);
+    free(engine->depthBuffer);
+    free(engine->warpDepth);
+    free(engine->warpPixels);
+    free(engine->holes);
+    if (engine->wavefront)
+    {
+        Wavefront_destroy(engine->wavefront);
+    }
+    free(engine->passRays);
+    free(engine->passPixels);
+    free(engine->heat);
     free(engine->blockOrder);
+    free(engine->spans);
+    free(engine->spanDone);
+    free(engine->workerCounters);
+    if (engine->pool)
+    {
+        WorkerPool_destroy(engine->pool);
+    }
+    if (engine->commandMutex) Mutex_destroy(engine->commandMutex);
+    if (engine->commandCondition) Condition_destroy(engine->commandCondition);
+    free(engine->commands);
+    free(engine->pendingCommands);
+    if (engine->publishedDirty) DirtyRegion_destroy(engine->publishedDirty);
 
     free(engine);
 }
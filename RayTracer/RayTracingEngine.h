@@ -2,20 +2,72 @@
 #define RAYTRACINGENGINE_H_INCLUDED
 
 #include "Framebuffer.h"
+#include "WorkerPool.h"
 
 #include "Scene.h"
 #include "Camera.h"
+#include "Stats.h"
 
 typedef struct RayTracingEngine RayTracingEngine;
 
-RayTracingEngine *RayTracingEngine_create(int width, int height, int blockWidth, float fov);
+typedef struct CancelStats
+{
+    int64_t cancelledSpans;
+    int64_t skippedPixels;
+    int64_t discardedPixels;
+} CancelStats;
+
+typedef enum HeatmapMode
+{
+    HEATMAP_OFF,
+    HEATMAP_TICKS,
+    HEATMAP_PRIMITIVE_TESTS
+} HeatmapMode;
+
+// rays and profile stay at zero unless the engine is built with RT_STATS
+typedef struct SimulateStats
+{
+    int64_t microseconds;
+    int64_t pixels;
+    RayCounts rays;
+    Stats profile;
+} SimulateStats;
+
+RayTracingEngine *RayTracingEngine_create(int width, int height, int blockWidth, float fov, int threadCount, int passesPerSimulate);
 
 int RayTracingEngine_getWidth(RayTracingEngine *engine);
 int RayTracingEngine_getHeight(RayTracingEngine *engine);
+int RayTracingEngine_getThreadCount(RayTracingEngine *engine);
+
+void RayTracingEngine_setMaxSamples(RayTracingEngine *engine, int maxSamples);
+void RayTracingEngine_setReprojectionEnabled(RayTracingEngine *engine, int enabled);
+void RayTracingEngine_setWavefrontEnabled(RayTracingEngine *engine, int enabled);
+// Returns 0 and keeps the current mode when asked for HEATMAP_PRIMITIVE_TESTS without RT_STATS
+int RayTracingEngine_setHeatmapMode(RayTracingEngine *engine, HeatmapMode mode);
+
+float RayTracingEngine_getHeatmap(RayTracingEngine *engine, float costs[]);
+void RayTracingEngine_renderHeatmap(RayTracingEngine *engine, Framebuffer *dest);
 
 void RayTracingEngine_simulate(RayTracingEngine *engine);
+int RayTracingEngine_simulateFor(RayTracingEngine *engine, int64_t microseconds);
+int RayTracingEngine_isComplete(RayTracingEngine *engine);
+
+void RayTracingEngine_getWorkerStats(RayTracingEngine *engine, WorkerStats stats[]);
+void RayTracingEngine_resetWorkerStats(RayTracingEngine *engine);
+
+void RayTracingEngine_getCancelStats(RayTracingEngine *engine, CancelStats *stats);
+void RayTracingEngine_resetCancelStats(RayTracingEngine *engine);
+
+void RayTracingEngine_getRayCounts(RayTracingEngine *engine, RayCounts *counts);
+void RayTracingEngine_resetRayCounts(RayTracingEngine *engine);
+
+void RayTracingEngine_getStats(RayTracingEngine *engine, SimulateStats *stats);
+
+int RayTracingEngine_startAsync(RayTracingEngine *engine);
+void RayTracingEngine_stopAsync(RayTracingEngine *engine);
 
 Framebuffer *RayTracingEngine_getRenderBuffer(RayTracingEngine *engine);
+Framebuffer *RayTracingEngine_getFrontBuffer(RayTracingEngine *engine);
 
 Scene *RayTracingEngine_getScene(RayTracingEngine *engine);
 
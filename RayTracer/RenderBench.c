@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "RayTracingEngine.h"
+#include "MappedImage.h"
+#include "CurvePath.h"
+#include "Timer.h"
+#include "Cpu.h"
+
+#define FRAMES 24
+#define BLOCK_WIDTH 6
+#define SKY_WIDTH 64
+#define SKY_HEIGHT 32
+
+typedef void (*SceneSetup)(Scene *scene, MappedImage *sky);
+
+// The camera starts at the origin looking down +z and follows a CurvePath from start through the waypoints
+typedef struct ReferenceScene
+{
+    const char *name;
+    SceneSetup setup;
+    Vec3 start;
+    Vec3 startDeriv;
+    Vec3 waypoints[2];
+} ReferenceScene;
+
+typedef struct Resolution
+{
+    int width;
+    int height;
+} Resolution;
+
+void setupTorus(Scene *scene, MappedImage *sky);
+void setupSphereField(Scene *scene, MappedImage *sky);
+void setupLightRoom(Scene *scene, MappedImage *sky);
+void setupMirrors(Scene *scene, MappedImage *sky);
+
+static const ReferenceScene scenes[] = {
+    {"torus", setupTorus, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 1.0f}, {{0.0f, 0.0f, 3.0f}, {1.0f, 3.0f, 5.0f}}},
+    {"sphere field", setupSphereField, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {{2.0f, 1.5f, 8.0f}, {-2.0f, 0.5f, 16.0f}}},
+    {"light room", setupLightRoom, {0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 1.0f}, {{2.0f, 0.5f, 5.0f}, {-2.0f, -0.5f, 9.0f}}},
+    {"mirrors", setupMirrors, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {{1.0f, 0.5f, 4.0f}, {-1.0f, 0.0f, 8.0f}}}
+};
+
+static const Resolution resolutions[] = {
+    {320, 240},
+    {640, 480}
+};
+
+void fillSky(uint8_t *pixels, int width, int height);
+
+void printProfile(FILE *out, Stats *profile);
+
+void printUsage(const char *program);
+
+int parseInt(const char *str, int min, int *out);
+
+double percentile(double sorted[], int count, double p);
+
+int compareDoubles(const void *a, const void *b);
+
+int64_t peakRssKilobytes();
+
+void fatalError(char *str);
+
+static uint8_t gradient[SKY_WIDTH * SKY_HEIGHT * 3];
+
+/*
+    Renders each reference scene at each resolution while the camera moves along the scene's path, FRAMES
+    frames of one sample per pixel, and writes the throughput and frame times as JSON. The report goes to
+    stdout unless an output path is given, a summary goes to stderr. Rays are counted with the profiling
+    stats, so the ray counts, rays per second and profile need the library and this program built with
+    RT_STATS. The RenderBench target compiles the library sources itself with it for that reason. Pixels per
+    second are always reported, though counting makes them a little lower than in a build without RT_STATS.
+*/
+int main(int argc, char **argv)
+{
+    int threads = 0;
+    const char *outPath = NULL;
+    const char *skyPath = "snow.ppm";
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = value != NULL;
+        if (ok && strcmp(arg, "-t") == 0)
+            ok = parseInt(value, 0, &threads);
+        else if (ok && strcmp(arg, "-o") == 0)
+            outPath = value;
+        else if (ok && strcmp(arg, "-sky") == 0)
+            skyPath = value;
+        else
+            ok = 0;
+
+        if (!ok)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out)
+    {
+        fatalError("Failed to open output file.");
+    }
+
+    // Without the sky image the torus reflects a gradient, the report says which one was used
+    MappedImage *sky = MappedImage_open(skyPath);
+    fillSky(gradient, SKY_WIDTH, SKY_HEIGHT);
+
+    int sceneCount = sizeof(scenes) / sizeof(scenes[0]);
+    int resolutionCount = sizeof(resolutions) / sizeof(resolutions[0]);
+    int threadCount = 0;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"cpu_level\": \"%s\",\n", Cpu_getLevelName(Cpu_getLevel()));
+    fprintf(out, "  \"sky\": \"%s\",\n", sky ? skyPath : "gradient");
+    fprintf(out, "  \"frames\": %d,\n", FRAMES);
+    fprintf(out, "  \"runs\": [\n");
+    for (int s = 0; s < sceneCount; s++)
+    {
+        for (int r = 0; r < resolutionCount; r++)
+        {
+            const ReferenceScene *reference = &scenes[s];
+            int width = resolutions[r].width;
+            int height = resolutions[r].height;
+
+            RayTracingEngine *engine = RayTracingEngine_create(width, height, BLOCK_WIDTH, 70.0f, threads, BLOCK_WIDTH * BLOCK_WIDTH);
+            CurvePath *path = CurvePath_create(reference->start, reference->startDeriv);
+            if (!engine || !path)
+            {
+                fatalError("Failed to create ray tracing engine.");
+            }
+            for (int w = 0; w < 2; w++)
+            {
+                CurvePath_addWaypoint(path, reference->waypoints[w]);
+            }
+            threadCount = RayTracingEngine_getThreadCount(engine);
+            RayTracingEngine_setMaxSamples(engine, 1);
+            reference->setup(RayTracingEngine_getScene(engine), sky);
+
+            // Scene_update runs on the first frame, building the hierarchies is not part of what is measured
+            RayTracingEngine_simulate(engine);
+
+            double frameMs[FRAMES];
+            Stats profile = {0};
+            int64_t pixels = 0;
+            Vec3 cameraPos = {0.0f, 0.0f, 0.0f};
+            RayTracingEngine_resetRayCounts(engine);
+            int64_t runStart = Timer_getMicroseconds();
+            for (int f = 0; f < FRAMES; f++)
+            {
+                Vec3 point = CurvePath_interpolate(path, (float) f / (FRAMES - 1));
+                RayTracingEngine_moveCamera(engine, Vec3_sub(point, cameraPos), 0.0f, 0.0f);
+                cameraPos = point;
+
+                int64_t frameStart = Timer_getMicroseconds();
+                while (!RayTracingEngine_isComplete(engine))
+                {
+                    RayTracingEngine_simulate(engine);
+                    SimulateStats stats;
+                    RayTracingEngine_getStats(engine, &stats);
+                    Stats_add(&profile, &stats.profile);
+                    pixels += stats.pixels;
+                }
+                frameMs[f] = (Timer_getMicroseconds() - frameStart) / 1000.0;
+            }
+            double seconds = (Timer_getMicroseconds() - runStart) / 1000000.0;
+
+            RayCounts counts;
+            RayTracingEngine_getRayCounts(engine, &counts);
+            qsort(frameMs, FRAMES, sizeof frameMs[0], compareDoubles);
+            double primary = counts.primary / seconds / 1e6;
+            double shadow = counts.shadow / seconds / 1e6;
+            double reflection = counts.reflection / seconds / 1e6;
+            double mpixels = pixels / seconds / 1e6;
+
+            fprintf(out, "    {\n");
+            fprintf(out, "      \"scene\": \"%s\",\n", reference->name);
+            fprintf(out, "      \"width\": %d,\n", width);
+            fprintf(out, "      \"height\": %d,\n", height);
+            fprintf(out, "      \"threads\": %d,\n", threadCount);
+            fprintf(out, "      \"seconds\": %.4f,\n", seconds);
+            fprintf(out, "      \"mpixels_per_second\": %.3f,\n", mpixels);
+            if (STATS_ENABLED)
+            {
+                fprintf(out, "      \"rays\": {\"primary\": %lld, \"shadow\": %lld, \"reflection\": %lld},\n",
+                        (long long) counts.primary, (long long) counts.shadow, (long long) counts.reflection);
+                fprintf(out, "      \"mrays_per_second\": {\"primary\": %.3f, \"shadow\": %.3f, \"reflection\": %.3f, \"total\": %.3f},\n",
+                        primary, shadow, reflection, primary + shadow + reflection);
+            }
+            fprintf(out, "      \"frame_ms\": {\"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+                    frameMs[0], percentile(frameMs, FRAMES, 0.5), percentile(frameMs, FRAMES, 0.9), percentile(frameMs, FRAMES, 0.99), frameMs[FRAMES - 1]);
+            if (STATS_ENABLED)
+            {
+                printProfile(out, &profile);
+            }
+            fprintf(out, "      \"peak_rss_kb\": %lld\n", (long long) peakRssKilobytes());
+            fprintf(out, "    }%s\n", s == sceneCount - 1 && r == resolutionCount - 1 ? "" : ",");
+
+            if (STATS_ENABLED)
+            {
+                fprintf(stderr, "%-14s %4dx%-4d %8.2f Mrays/s (primary %.2f, shadow %.2f, reflection %.2f), p50 frame %.2f ms\n",
+                        reference->name, width, height, primary + shadow + reflection, primary, shadow, reflection, percentile(frameMs, FRAMES, 0.5));
+            }
+            else
+            {
+                fprintf(stderr, "%-14s %4dx%-4d %8.2f Mpixels/s, p50 frame %.2f ms\n",
+                        reference->name, width, height, mpixels, percentile(frameMs, FRAMES, 0.5));
+            }
+
+            CurvePath_destroy(path);
+            RayTracingEngine_destroy(engine);
+        }
+    }
+    fprintf(out, "  ],\n");
+    fprintf(out, "  \"peak_rss_kb\": %lld\n", (long long) peakRssKilobytes());
+    fprintf(out, "}\n");
+
+    if (outPath)
+    {
+        fclose(out);
+    }
+    if (sky)
+    {
+        MappedImage_close(sky);
+    }
+    return 0;
+}
+
+// The demo scene of main.c, a mirror torus around a single light
+void setupTorus(Scene *scene, MappedImage *sky)
+{
+    if (sky)
+        Scene_setSky(scene, MappedImage_getPixels(sky), MappedImage_getWidth(sky), MappedImage_getHeight(sky), 0, 1);
+    else
+        Scene_setSky(scene, gradient, SKY_WIDTH, SKY_HEIGHT, 0, 1);
+    Scene_addPointLight(scene, (Vec3) {0.0f, 0.0f, 0.0f}, (Vec3) {1.0f, 1.0f, 1.0f}, 20.0f);
+
+    Scene_addTorus(scene, (Vec3) {0.0f, 0.0f, 8.0f}, 2.0f, 1.0f, 0.0f, M_PI / 2, Material_create((Vec3) {1.0f, 1.0f, 1.0f}, (Vec3) {1.0f, 1.0f, 1.0f}, 1.0f));
+}
+
+// 1600 small spheres over a floor, mostly primary rays and their hierarchy traversal
+void setupSphereField(Scene *scene, MappedImage *sky)
+{
+    Scene_setSky(scene, gradient, SKY_WIDTH, SKY_HEIGHT, 1, 1);
+    Scene_addPointLight(scene, (Vec3) {0.0f, 8.0f, 10.0f}, (Vec3) {1.0f, 0.95f, 0.9f}, 40.0f);
+    Scene_addPointLight(scene, (Vec3) {-10.0f, 5.0f, 30.0f}, (Vec3) {0.4f, 0.5f, 0.9f}, 30.0f);
+
+    Scene_addPlane(scene, (Vec3) {0.0f, -2.0f, 24.0f}, 60.0f, 60.0f, 0.0f, 0.0f, Material_create((Vec3) {0.6f, 0.6f, 0.6f}, (Vec3) {1.0f, 1.0f, 1.0f}, 0.0f));
+    for (int z = 0; z < 40; z++)
+    {
+        for (int x = 0; x < 40; x++)
+        {
+            Vec3 color = {0.3f + 0.7f * (x % 3) / 2.0f, 0.3f + 0.7f * (z % 4) / 3.0f, 0.3f + 0.7f * ((x + z) % 5) / 4.0f};
+            float specular = (x + z) % 4 == 0 ? 0.3f : 0.0f;
+            Scene_addSphere(scene, (Vec3) {x - 19.5f, -1.6f + 0.1f * (x % 2), 4.0f + z}, 0.35f, Material_create(color, (Vec3) {1.0f, 1.0f, 1.0f}, specular));
+        }
+    }
+}
+
+// A closed room lit by 256 short range lights under the ceiling, mostly shadow rays
+void setupLightRoom(Scene *scene, MappedImage *sky)
+{
+    Material wall = Material_create((Vec3) {0.8f, 0.8f, 0.75f}, (Vec3) {1.0f, 1.0f, 1.0f}, 0.0f);
+    Scene_addPlane(scene, (Vec3) {0.0f, -3.0f, 8.0f}, 20.0f, 20.0f, 0.0f, 0.0f, wall);
+    Scene_addPlane(scene, (Vec3) {0.0f, 5.0f, 8.0f}, 20.0f, 20.0f, 0.0f, M_PI, wall);
+    Scene_addPlane(scene, (Vec3) {0.0f, 1.0f, 18.0f}, 20.0f, 8.0f, 0.0f, M_PI / 2, wall);
+    Scene_addPlane(scene, (Vec3) {0.0f, 1.0f, -2.0f}, 20.0f, 8.0f, 0.0f, -M_PI / 2, wall);
+    Scene_addPlane(scene, (Vec3) {10.0f, 1.0f, 8.0f}, 20.0f, 8.0f, M_PI / 2, M_PI / 2, wall);
+    Scene_addPlane(scene, (Vec3) {-10.0f, 1.0f, 8.0f}, 20.0f, 8.0f, -M_PI / 2, M_PI / 2, wall);
+
+    for (int i = 0; i < 256; i++)
+    {
+        Vec3 pos = {(i % 16) * 1.2f - 9.0f, 4.5f, (i / 16) * 1.2f - 1.0f};
+        Vec3 color = {0.2f + 0.1f * (i % 3), 0.2f + 0.1f * (i % 5) / 2.0f, 0.25f};
+        Scene_addPointLight(scene, pos, color, 5.0f);
+    }
+
+    for (int i = 0; i < 12; i++)
+    {
+        Vec3 center = {(i % 4) * 4.0f - 6.0f, -2.0f, 6.0f + (i / 4) * 4.0f};
+        Scene_addSphere(scene, center, 1.0f, Material_create((Vec3) {0.9f, 0.4f + 0.05f * i, 0.3f}, (Vec3) {1.0f, 1.0f, 1.0f}, 0.2f));
+    }
+}
+
+// Two facing mirrors with reflective shapes between them, so most rays bounce up to the reflection limit
+void setupMirrors(Scene *scene, MappedImage *sky)
+{
+    Scene_setSky(scene, gradient, SKY_WIDTH, SKY_HEIGHT, 1, 1);
+    Scene_addPointLight(scene, (Vec3) {0.0f, 3.0f, 6.0f}, (Vec3) {1.0f, 1.0f, 1.0f}, 25.0f);
+    Scene_addPointLight(scene, (Vec3) {2.0f, -1.0f, 2.0f}, (Vec3) {0.8f, 0.6f, 0.4f}, 15.0f);
+
+    Material mirror = Material_create((Vec3) {0.1f, 0.1f, 0.1f}, (Vec3) {0.95f, 0.95f, 1.0f}, 0.9f);
+    Scene_addPlane(scene, (Vec3) {4.0f, 0.0f, 8.0f}, 20.0f, 10.0f, M_PI / 2, M_PI / 2, mirror);
+    Scene_addPlane(scene, (Vec3) {-4.0f, 0.0f, 8.0f}, 20.0f, 10.0f, -M_PI / 2, M_PI / 2, mirror);
+    Scene_addPlane(scene, (Vec3) {0.0f, -3.0f, 8.0f}, 8.0f, 20.0f, 0.0f, 0.0f, Material_create((Vec3) {0.7f, 0.7f, 0.7f}, (Vec3) {1.0f, 1.0f, 1.0f}, 0.5f));
+
+    for (int i = 0; i < 6; i++)
+    {
+        Vec3 center = {(i % 2) * 3.0f - 1.5f, -1.5f + (i % 3) * 1.2f, 6.0f + i * 1.5f};
+        Scene_addSphere(scene, center, 0.7f, Material_create((Vec3) {0.8f, 0.3f, 0.2f + 0.1f * i}, (Vec3) {1.0f, 1.0f, 1.0f}, 0.8f));
+    }
+    Scene_addTorus(scene, (Vec3) {0.0f, 0.5f, 14.0f}, 1.5f, 0.5f, 0.3f, M_PI / 3, Material_create((Vec3) {1.0f, 1.0f, 1.0f}, (Vec3) {1.0f, 1.0f, 1.0f}, 1.0f));
+}
+
+// Latitude-longitude gradient, blue overhead fading to a pale horizon with dark ground below it
+void fillSky(uint8_t *pixels, int width, int height)
+{
+    const float zenith[3] = {60.0f, 110.0f, 200.0f};
+    const float horizon[3] = {225.0f, 230.0f, 235.0f};
+    const float ground[3] = {70.0f, 65.0f, 60.0f};
+    for (int y = 0; y < height; y++)
+    {
+        // Row 0 looks straight up
+        float v = (float) y / (height - 1);
+        uint8_t color[3];
+        for (int c = 0; c < 3; c++)
+        {
+            float value = v < 0.5f ? zenith[c] + (horizon[c] - zenith[c]) * v * 2.0f : ground[c];
+            color[c] = (uint8_t) value;
+        }
+        for (int x = 0; x < width; x++)
+        {
+            memcpy(pixels + (x + y * width) * 3, color, 3);
+        }
+    }
+}
+
+// Only in builds with RT_STATS, ticks are processor cycles on x86 and microseconds elsewhere
+void printProfile(FILE *out, Stats *profile)
+{
+    fprintf(out, "      \"profile\": {\n");
+    for (int i = 0; i < STAT_COUNTER_COUNT; i++)
+    {
+        fprintf(out, "        \"%s\": %lld,\n", Stats_getCounterName(i), (long long) profile->counters[i]);
+    }
+    for (int i = 0; i < STAT_TIMER_COUNT; i++)
+    {
+        fprintf(out, "        \"%s\": {\"ticks\": %lld, \"calls\": %lld}%s\n", Stats_getTimerName(i),
+                (long long) profile->ticks[i], (long long) profile->calls[i], i == STAT_TIMER_COUNT - 1 ? "" : ",");
+    }
+    fprintf(out, "      },\n");
+}
+
+void printUsage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-t threads] [-o report.json] [-sky sky.ppm]\n", program);
+    fprintf(stderr, "A thread count of 0 uses one thread per core. The report goes to stdout without -o.\n");
+}
+
+// Returns 0 unless str is a whole number no less than min
+int parseInt(const char *str, int min, int *out)
+{
+    char *end;
+    long value = strtol(str, &end, 10);
+    if (end == str || *end != '\0' || value < min || value > 65535)
+        return 0;
+    *out = (int) value;
+    return 1;
+}
+
+// Nearest rank percentile of count ascending values, p from 0 to 1
+double percentile(double sorted[], int count, double p)
+{
+    int rank = (int) ceil(p * count) - 1;
+    rank = rank < 0 ? 0 : rank >= count ? count - 1 : rank;
+    return sorted[rank];
+}
+
+int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// Largest resident set of the process so far
+int64_t peakRssKilobytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters))
+        return 0;
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+void fatalError(char *str)
+{
+    fprintf(stderr, "%s\n", str);
+    exit(1);
+}
@@ -5,13 +5,45 @@
 
 #include "Vec3.h"
 #include "Material.h"
+#include "Cpu.h"
 
 typedef struct Scene Scene;
 
+typedef struct SceneHit
+{
+    float t;
+    Vec3 hitPoint;
+    Vec3 normal;
+    Material material;
+} SceneHit;
+
+// Primary rays start at the camera, reflection rays at the surface they bounced off. Counted only with RT_STATS.
+typedef struct RayCounts
+{
+    int64_t primary;
+    int64_t shadow;
+    int64_t reflection;
+} RayCounts;
+
+typedef enum TorusSolver
+{
+    TORUS_SOLVER_ANALYTIC,
+    TORUS_SOLVER_SAMPLED
+} TorusSolver;
+
+typedef enum SkyLookup
+{
+    SKY_LOOKUP_CUBEMAP,
+    SKY_LOOKUP_EQUIRECT
+} SkyLookup;
+
 Scene *Scene_create();
 
 void Scene_setSky(Scene *scene, uint8_t *pixels, int width, int height, int skyEnabled, int reflectionsEnabled);
 
+// Looking the sky up in a cubemap avoids two inverse trig functions per miss, the equirectangular lookup samples the image itself
+void Scene_setSkyLookup(Scene *scene, SkyLookup lookup);
+
 void Scene_addPointLight(Scene *scene, Vec3 pos, Vec3 col, float dist);
 
 void Scene_addPlane(Scene *scene, Vec3 center, float width, float height, float yaw, float pitch, Material material);
@@ -20,7 +52,49 @@ void Scene_addSphere(Scene *scene, Vec3 center, float radius, Material material)
 
 void Scene_addTorus(Scene *scene, Vec3 center, float radius, float tubeRadius, float yaw, float pitch, Material material);
 
-Vec3 Scene_trace(Scene *scene, Vec3 start, Vec3 rayDir);
+void Scene_update(Scene *scene);
+
+void Scene_setBvhEnabled(Scene *scene, int enabled);
+
+// Point lights are looked up in a grid over their ranges, so shading only visits lights that can reach the point
+void Scene_setLightGridEnabled(Scene *scene, int enabled);
+
+void Scene_setTorusSolver(Scene *scene, TorusSolver solver);
+
+// Selects which builds of the sphere pack and camera ray kernels are used, levels above what the processor supports are lowered to it
+void Scene_setCpuLevel(Scene *scene, CpuLevel level);
+
+CpuLevel Scene_getCpuLevel(Scene *scene);
+
+// Bounces past the first hit, 0 turns reflections off. Defaults to 5.
+void Scene_setMaxReflections(Scene *scene, int maxReflections);
+
+// A reflection is abandoned once all of its color channels would be scaled below this. The default of 0 follows
+// every bounce up to the maximum. Above 0 a skipped bounce loses at most minThroughput times the unclamped color
+// it would have seen, which exceeds one step of the 8 bit output wherever lights add up to more than 1.
+void Scene_setMinThroughput(Scene *scene, float minThroughput);
+
+int Scene_occluded(Scene *scene, Vec3 origin, Vec3 rayDir, float maxT);
+
+Vec3 Scene_trace(Scene *scene, Vec3 start, Vec3 rayDir, float *depth);
+
+// Closest hit along the ray, returns 0 if it leaves the scene
+int Scene_intersect(Scene *scene, Vec3 start, Vec3 rayDir, SceneHit *hit);
+
+// Returns 0 if the sky is not shown to rays that have reflected bounce times
+int Scene_getSkyColor(Scene *scene, Vec3 dir, int bounce, Vec3 *color);
+
+// Light every hit receives before any point light is added
+Vec3 Scene_getAmbientLight(Scene *scene);
+
+// Lights that may reach point, in ascending order. Sets *lights to NULL when the candidates are all lights from 0 up to the count.
+int Scene_getLightCandidates(Scene *scene, Vec3 point, const int **lights);
+
+// Returns 0 if the light cannot reach the hit, otherwise the shadow ray from the hit point and what the light adds when nothing blocks it
+int Scene_getShadowRay(Scene *scene, const SceneHit *hit, int light, Vec3 *dir, float *maxT, Vec3 *contribution);
+
+// Returns 1 if the ray continues past hit after bounce reflections, with throughput scaled and dir reflected for the next bounce
+int Scene_reflect(Scene *scene, const SceneHit *hit, int bounce, Vec3 *throughput, Vec3 *dir);
 
 void Scene_destroy(Scene *scene);
 
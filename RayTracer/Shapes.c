@@ -0,0 +1,458 @@
+#include "Shapes.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "MathFunctions.h"
+#include "Stats.h"
+
+#if CPU_DISPATCH
+#include <immintrin.h>
+#endif
+
+static const float EPSILON = 0.001f;
+
+// Bounds are padded so that hits found by the intersection functions never fall just outside them
+static const float BOUNDS_PAD = 0.01f;
+
+Plane Plane_create(Vec3 center, float width, float height, float yaw, float pitch, Material material)
+{
+    Plane plane;
+    plane.center = center;
+    plane.halfWidth = width * 0.5f;
+    plane.halfHeight = height * 0.5f;
+    plane.yaw = yaw;
+    plane.pitch = pitch;
+    plane.rotate = Mat4_mul(Mat4_rotateY(plane.yaw), Mat4_rotateX(plane.pitch));
+    plane.translate = Mat4_translate(plane.center);
+    plane.rotateInverse = Mat4_inverse(plane.rotate);
+    plane.translateInverse = Mat4_inverse(plane.translate);
+    plane.worldToLocal = Mat3x4_fromMat4(Mat4_mul(plane.rotateInverse, plane.translateInverse));
+    plane.material = material;
+    return plane;
+}
+
+// Each intersect function returns the nearest t > EPSILON at which the ray hits the shape, or -1 on a miss
+float Plane_intersect(Plane *plane, Vec3 start, Vec3 rayDir, Vec3 *localHitPoint)
+{
+    Vec3 st = Mat3x4_mulVec3(&plane->worldToLocal, start);
+    Vec3 dr = Mat3x4_mulDir(&plane->worldToLocal, rayDir);
+
+    float t = -st.y / dr.y;
+    Vec3 hitPoint = (Vec3) {st.x + t * dr.x, 0.0f, st.z + t * dr.z};
+    if (t > EPSILON && abs(hitPoint.x) < plane->halfWidth && abs(hitPoint.z) < plane->halfHeight)
+    {
+        *localHitPoint = hitPoint;
+        return t;
+    }
+    return -1.0f;
+}
+
+Vec3 Plane_normal(Plane *plane, Vec3 localHitPoint)
+{
+    return Mat4_mulVec3(plane->rotate, (Vec3) {0.0f, 1.0f, 0.0f});
+}
+
+Aabb Plane_bounds(Plane *plane)
+{
+    // The extent test above truncates to whole units, so the plane reaches out to the next integer
+    float hw = ceilf(plane->halfWidth);
+    float hh = ceilf(plane->halfHeight);
+    Mat4 toWorld = Mat4_mul(plane->translate, plane->rotate);
+
+    Aabb box = Aabb_empty();
+    box = Aabb_addPoint(box, Mat4_mulVec3(toWorld, (Vec3) {-hw, 0.0f, -hh}));
+    box = Aabb_addPoint(box, Mat4_mulVec3(toWorld, (Vec3) { hw, 0.0f, -hh}));
+    box = Aabb_addPoint(box, Mat4_mulVec3(toWorld, (Vec3) {-hw, 0.0f,  hh}));
+    box = Aabb_addPoint(box, Mat4_mulVec3(toWorld, (Vec3) { hw, 0.0f,  hh}));
+    return Aabb_pad(box, BOUNDS_PAD);
+}
+
+Sphere Sphere_create(Vec3 center, float radius, Material material)
+{
+    Sphere sphere;
+    sphere.center = center;
+    sphere.radius = radius;
+    sphere.translate = Mat4_translate(sphere.center);
+    sphere.translateInverse = Mat4_inverse(sphere.translate);
+    sphere.material = material;
+    return sphere;
+}
+
+float Sphere_intersect(Sphere *sphere, Vec3 start, Vec3 rayDir, Vec3 *localHitPoint)
+{
+    Vec3 st = Vec3_sub(start, sphere->center);
+    Vec3 dr = rayDir;
+
+    float A = st.x;
+    float B = st.y;
+    float C = st.z;
+    float a = dr.x*dr.x + dr.y*dr.y + dr.z*dr.z;
+    float b = 2 * (A*dr.x + B*dr.y + C*dr.z);
+    float c = A*A + B*B + C*C - sphere->radius * sphere->radius;
+    float disc = b*b - 4*a*c;
+    if (disc >= 0.0f)
+    {
+        float sqrtDisc = sqrt(disc);
+        float a2 = 1 / (a * 2);
+        float t1 = (-b + sqrtDisc) * a2;
+        float t2 = (-b - sqrtDisc) * a2;
+        float t = t2 > EPSILON ? t2 : t1 > EPSILON ? t1 : -1.0f;
+        if (t > 0.0f)
+        {
+            *localHitPoint = Vec3_add(st, Vec3_mulScalar(dr, t));
+        }
+        return t;
+    }
+    return -1.0f;
+}
+
+Vec3 Sphere_normal(Sphere *sphere, Vec3 localHitPoint)
+{
+    return Vec3_mulScalar(localHitPoint, 1.0f / sphere->radius);
+}
+
+Aabb Sphere_bounds(Sphere *sphere)
+{
+    Vec3 r = {sphere->radius, sphere->radius, sphere->radius};
+    return Aabb_pad((Aabb) {Vec3_sub(sphere->center, r), Vec3_add(sphere->center, r)}, BOUNDS_PAD);
+}
+
+// Arrays are kept a multiple of SPHERE_PACK_WIDTH long. Unused slots hold NaN, which never passes the discriminant test.
+#define SPHERE_PACK_WIDTH 8
+
+SpherePack *SpherePack_create()
+{
+    SpherePack *pack = malloc(sizeof *pack);
+    if (pack)
+    {
+        pack->centerX = NULL;
+        pack->centerY = NULL;
+        pack->centerZ = NULL;
+        pack->radiusSq = NULL;
+        pack->count = 0;
+        pack->size = 0;
+    }
+    return pack;
+}
+
+static int SpherePack_grow(float **arr, int oldSize, int newSize)
+{
+    float *newArr = realloc(*arr, sizeof *newArr * newSize);
+    if (!newArr)
+        return 0;
+    for (int i = oldSize; i < newSize; i++)
+    {
+        newArr[i] = NAN;
+    }
+    *arr = newArr;
+    return 1;
+}
+
+// Returns 0 and leaves the pack unchanged if it could not grow
+int SpherePack_add(SpherePack *pack, Vec3 center, float radius)
+{
+    if (pack->count == pack->size)
+    {
+        int newSize = pack->size > 0 ? pack->size * 2 : SPHERE_PACK_WIDTH;
+        if (!SpherePack_grow(&pack->centerX, pack->size, newSize) ||
+            !SpherePack_grow(&pack->centerY, pack->size, newSize) ||
+            !SpherePack_grow(&pack->centerZ, pack->size, newSize) ||
+            !SpherePack_grow(&pack->radiusSq, pack->size, newSize))
+        {
+            return 0;
+        }
+        pack->size = newSize;
+    }
+    pack->centerX[pack->count] = center.x;
+    pack->centerY[pack->count] = center.y;
+    pack->centerZ[pack->count] = center.z;
+    pack->radiusSq[pack->count] = radius * radius;
+    pack->count++;
+    return 1;
+}
+
+// Same arithmetic in the same order as Sphere_intersect, so both give bit-identical distances
+static float SpherePack_intersectOne(SpherePack *pack, int i, Vec3 start, Vec3 rayDir, float a)
+{
+    float A = start.x - pack->centerX[i];
+    float B = start.y - pack->centerY[i];
+    float C = start.z - pack->centerZ[i];
+    float b = 2 * (A*rayDir.x + B*rayDir.y + C*rayDir.z);
+    float c = A*A + B*B + C*C - pack->radiusSq[i];
+    float disc = b*b - 4*a*c;
+    if (disc >= 0.0f)
+    {
+        float sqrtDisc = sqrt(disc);
+        float a2 = 1 / (a * 2);
+        float t1 = (-b + sqrtDisc) * a2;
+        float t2 = (-b - sqrtDisc) * a2;
+        return t2 > EPSILON ? t2 : t1 > EPSILON ? t1 : -1.0f;
+    }
+    return -1.0f;
+}
+
+#if CPU_DISPATCH
+// Tests SPHERE_PACK_WIDTH spheres per iteration. With closest set it returns the nearest sphere under maxT and updates maxT, otherwise the first sphere hit within maxT.
+CPU_TARGET_AVX2 static int SpherePack_intersectAvx(SpherePack *pack, Vec3 start, Vec3 rayDir, float *maxT, int closest)
+{
+    float a = rayDir.x*rayDir.x + rayDir.y*rayDir.y + rayDir.z*rayDir.z;
+    __m256 startX = _mm256_set1_ps(start.x);
+    __m256 startY = _mm256_set1_ps(start.y);
+    __m256 startZ = _mm256_set1_ps(start.z);
+    __m256 dirX = _mm256_set1_ps(rayDir.x);
+    __m256 dirY = _mm256_set1_ps(rayDir.y);
+    __m256 dirZ = _mm256_set1_ps(rayDir.z);
+    __m256 fourA = _mm256_set1_ps(4 * a);
+    __m256 a2 = _mm256_set1_ps(1 / (a * 2));
+    __m256 two = _mm256_set1_ps(2.0f);
+    __m256 epsilon = _mm256_set1_ps(EPSILON);
+    __m256 miss = _mm256_set1_ps(-1.0f);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 signBit = _mm256_set1_ps(-0.0f);
+
+    int best = -1;
+    float bestT = *maxT;
+    for (int i = 0; i < pack->count; i += SPHERE_PACK_WIDTH)
+    {
+        __m256 A = _mm256_sub_ps(startX, _mm256_loadu_ps(pack->centerX + i));
+        __m256 B = _mm256_sub_ps(startY, _mm256_loadu_ps(pack->centerY + i));
+        __m256 C = _mm256_sub_ps(startZ, _mm256_loadu_ps(pack->centerZ + i));
+        __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(A, dirX), _mm256_mul_ps(B, dirY)), _mm256_mul_ps(C, dirZ));
+        __m256 b = _mm256_mul_ps(two, dot);
+        __m256 lenSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(A, A), _mm256_mul_ps(B, B)), _mm256_mul_ps(C, C));
+        __m256 c = _mm256_sub_ps(lenSq, _mm256_loadu_ps(pack->radiusSq + i));
+        __m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(fourA, c));
+        __m256 hasRoots = _mm256_cmp_ps(disc, zero, _CMP_GE_OQ);
+        if (!_mm256_movemask_ps(hasRoots))
+            continue;
+
+        __m256 sqrtDisc = _mm256_sqrt_ps(disc);
+        __m256 negB = _mm256_xor_ps(b, signBit);
+        __m256 t1 = _mm256_mul_ps(_mm256_add_ps(negB, sqrtDisc), a2);
+        __m256 t2 = _mm256_mul_ps(_mm256_sub_ps(negB, sqrtDisc), a2);
+        __m256 t = _mm256_blendv_ps(miss, t1, _mm256_cmp_ps(t1, epsilon, _CMP_GT_OQ));
+        t = _mm256_blendv_ps(t, t2, _mm256_cmp_ps(t2, epsilon, _CMP_GT_OQ));
+
+        __m256 maxTs = _mm256_set1_ps(bestT);
+        __m256 inRange = closest ? _mm256_cmp_ps(t, maxTs, _CMP_LT_OQ) : _mm256_cmp_ps(t, maxTs, _CMP_LE_OQ);
+        __m256 hit = _mm256_and_ps(_mm256_and_ps(hasRoots, inRange), _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+        int lanes = _mm256_movemask_ps(hit);
+        if (!lanes)
+            continue;
+        if (!closest)
+            return i + __builtin_ctz(lanes);
+
+        // Lanes are visited in order so that ties go to the lower index, as in a sequential loop
+        float ts[SPHERE_PACK_WIDTH];
+        _mm256_storeu_ps(ts, t);
+        for (int lane = 0; lane < SPHERE_PACK_WIDTH; lane++)
+        {
+            if ((lanes >> lane & 1) && ts[lane] < bestT)
+            {
+                bestT = ts[lane];
+                best = i + lane;
+            }
+        }
+    }
+    *maxT = bestT;
+    return best;
+}
+#endif
+
+// Returns the index of the closest sphere hit nearer than maxT and sets maxT to its distance, or -1 if there is none
+int SpherePack_intersect(SpherePack *pack, Vec3 start, Vec3 rayDir, float *maxT, CpuLevel level)
+{
+#if CPU_DISPATCH
+    if (level >= CPU_LEVEL_AVX2)
+        return SpherePack_intersectAvx(pack, start, rayDir, maxT, 1);
+#endif
+    float a = rayDir.x*rayDir.x + rayDir.y*rayDir.y + rayDir.z*rayDir.z;
+    int best = -1;
+    for (int i = 0; i < pack->count; i++)
+    {
+        float t = SpherePack_intersectOne(pack, i, start, rayDir, a);
+        if (t > 0.0f && t < *maxT)
+        {
+            *maxT = t;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Returns 1 if any sphere is hit no further away than maxT
+int SpherePack_occluded(SpherePack *pack, Vec3 start, Vec3 rayDir, float maxT, CpuLevel level)
+{
+#if CPU_DISPATCH
+    if (level >= CPU_LEVEL_AVX2)
+        return SpherePack_intersectAvx(pack, start, rayDir, &maxT, 0) >= 0;
+#endif
+    float a = rayDir.x*rayDir.x + rayDir.y*rayDir.y + rayDir.z*rayDir.z;
+    for (int i = 0; i < pack->count; i++)
+    {
+        float t = SpherePack_intersectOne(pack, i, start, rayDir, a);
+        if (t > 0.0f && t <= maxT)
+            return 1;
+    }
+    return 0;
+}
+
+void SpherePack_destroy(SpherePack *pack)
+{
+    free(pack->centerX);
+    free(pack->centerY);
+    free(pack->centerZ);
+    free(pack->radiusSq);
+    free(pack);
+}
+
+Torus Torus_create(Vec3 center, float radius, float tubeRadius, float yaw, float pitch, Material material)
+{
+    if (tubeRadius > radius)
+    {
+        tubeRadius = radius;
+    }
+    Torus torus;
+    torus.center = center;
+    torus.radius = radius;
+    torus.tubeRadius = tubeRadius;
+    torus.yaw = yaw;
+    torus.pitch = pitch;
+    torus.translate = Mat4_translate(torus.center);
+    torus.translateInverse = Mat4_inverse(torus.translate);
+    torus.rotate = Mat4_mul(Mat4_rotateY(torus.yaw), Mat4_rotateX(torus.pitch));
+    torus.rotateInverse = Mat4_inverse(torus.rotate);
+    torus.worldToLocal = Mat3x4_fromMat4(Mat4_mul(torus.rotateInverse, torus.translateInverse));
+    torus.material = material;
+    return torus;
+}
+
+typedef struct TorusConstants
+{
+    float R2_minus_r2;
+    float _4R2;
+    float xs, xd;
+    float ys, yd;
+    float zs, zd;
+} TorusConstants;
+
+static float torusFunction(float t, void *constants)
+{
+    TorusConstants *tc = (TorusConstants*) constants;
+    Stats_count(STAT_SAMPLED_TORUS_EVALUATIONS, 1);
+
+    float x = tc->xs + t * tc->xd;
+    float y = tc->ys + t * tc->yd;
+    float z = tc->zs + t * tc->zd;
+    float x2 = x * x;
+    float y2 = y * y;
+    float z2 = z * z;
+
+    float sum_x2_z2 = x2 + z2;
+    float part1 = sum_x2_z2 + y2 + tc->R2_minus_r2;
+    part1 *= part1;
+    float part2 = -tc->_4R2 * sum_x2_z2;
+
+    return part1 + part2;
+}
+
+// Searches for the first sign change of the torus function with 50 samples and 25 bisection steps
+float Torus_intersectSampled(Torus *torus, Vec3 start, Vec3 rayDir, Vec3 *localHitPoint)
+{
+    Vec3 st = Mat3x4_mulVec3(&torus->worldToLocal, start);
+    Vec3 dr = Mat3x4_mulDir(&torus->worldToLocal, rayDir);
+
+    float R2 = torus->radius * torus->radius;
+    TorusConstants tc =
+    {
+        .R2_minus_r2 = R2 - torus->tubeRadius * torus->tubeRadius,
+        ._4R2 = 4 * R2,
+        .xs = st.x, .xd = dr.x,
+        .ys = st.y, .yd = dr.y,
+        .zs = st.z, .zd = dr.z
+    };
+
+    float dist = Vec3_len(st);
+    float outerRadius = (torus->radius + torus->tubeRadius) * 1.3f;
+    float tMin = dist - outerRadius;
+    tMin = tMin < EPSILON ? EPSILON : tMin;
+    float tMax = dist + outerRadius;
+    float t = -1.0f;
+    MathFunctions_findRootsF(torusFunction, &tc, tMin, tMax, &t, 1, 50, 25);
+
+    if (t > EPSILON)
+    {
+        *localHitPoint = Vec3_add(st, Vec3_mulScalar(dr, t));
+        return t;
+    }
+    return -1.0f;
+}
+
+// Solves the torus quartic in closed form, which is exact up to rounding and cannot step over thin grazing hits
+float Torus_intersect(Torus *torus, Vec3 start, Vec3 rayDir, Vec3 *localHitPoint)
+{
+    Vec3 st = Mat3x4_mulVec3(&torus->worldToLocal, start);
+    Vec3 dr = Mat3x4_mulDir(&torus->worldToLocal, rayDir);
+
+    // Rays that start far away are moved up to the bounding sphere first, which keeps the coefficients well conditioned
+    float outerRadius = torus->radius + torus->tubeRadius;
+    double t0 = Vec3_len(st) - outerRadius;
+    t0 = t0 < 0.0 ? 0.0 : t0;
+    double sx = st.x + t0 * dr.x;
+    double sy = st.y + t0 * dr.y;
+    double sz = st.z + t0 * dr.z;
+    double dx = dr.x;
+    double dy = dr.y;
+    double dz = dr.z;
+
+    // ((p.p + R^2 - r^2)^2 - 4R^2(px^2 + pz^2)) expanded in t for p = s + t*d
+    double R2 = (double) torus->radius * torus->radius;
+    double k = R2 - (double) torus->tubeRadius * torus->tubeRadius;
+    double dd = dx * dx + dy * dy + dz * dz;
+    double sd = sx * dx + sy * dy + sz * dz;
+    double ssk = sx * sx + sy * sy + sz * sz + k;
+    double c4 = dd * dd;
+    double c3 = 4.0 * dd * sd;
+    double c2 = 4.0 * sd * sd + 2.0 * dd * ssk - 4.0 * R2 * (dx * dx + dz * dz);
+    double c1 = 4.0 * sd * ssk - 8.0 * R2 * (sx * dx + sz * dz);
+    double c0 = ssk * ssk - 4.0 * R2 * (sx * sx + sz * sz);
+
+    double roots[4];
+    int rootCount = MathFunctions_solveQuartic(c4, c3, c2, c1, c0, roots);
+    float t = -1.0f;
+    for (int i = 0; i < rootCount; i++)
+    {
+        float rootT = (float) (t0 + roots[i]);
+        if (rootT > EPSILON && (t < 0.0f || rootT < t))
+        {
+            t = rootT;
+        }
+    }
+
+    if (t > EPSILON)
+    {
+        *localHitPoint = Vec3_add(st, Vec3_mulScalar(dr, t));
+        return t;
+    }
+    return -1.0f;
+}
+
+Vec3 Torus_normal(Torus *torus, Vec3 localHitPoint)
+{
+    Vec3 toHitXZ = {localHitPoint.x, 0.0f, localHitPoint.z};
+    float len = Vec3_len(toHitXZ);
+    toHitXZ = Vec3_mulScalar(toHitXZ, 1.0f / len);
+    float xComp = len - torus->radius;
+    float yComp = localHitPoint.y;
+    Vec3 localNormal = Vec3_mulScalar(Vec3_add(Vec3_mulScalar(toHitXZ, xComp), (Vec3) {0.0f, yComp, 0.0f}), 1.0f / torus->tubeRadius);
+
+    return Mat4_mulVec3(torus->rotate, localNormal);
+}
+
+Aabb Torus_bounds(Torus *torus)
+{
+    float outer = torus->radius + torus->tubeRadius;
+    Vec3 r = {outer, outer, outer};
+    return Aabb_pad((Aabb) {Vec3_sub(torus->center, r), Vec3_add(torus->center, r)}, BOUNDS_PAD);
+}
@@ -0,0 +1,83 @@
+#ifndef SHAPES_H_INCLUDED
+#define SHAPES_H_INCLUDED
+
+#include "Vec3.h"
+#include "Mat4.h"
+#include "Mat3x4.h"
+#include "Material.h"
+#include "Aabb.h"
+#include "Cpu.h"
+
+typedef struct Plane
+{
+    Vec3 center;
+    float halfWidth;
+    float halfHeight;
+    float yaw;
+    float pitch;
+    Mat4 translate;
+    Mat4 translateInverse;
+    Mat4 rotate;
+    Mat4 rotateInverse;
+    Mat3x4 worldToLocal;
+    Material material;
+} Plane;
+
+typedef struct Sphere
+{
+    Vec3 center;
+    float radius;
+    Mat4 translate;
+    Mat4 translateInverse;
+    Material material;
+} Sphere;
+
+typedef struct Torus
+{
+    Vec3 center;
+    float radius;
+    float tubeRadius;
+    float yaw;
+    float pitch;
+    Mat4 translate;
+    Mat4 translateInverse;
+    Mat4 rotate;
+    Mat4 rotateInverse;
+    Mat3x4 worldToLocal;
+    Material material;
+} Torus;
+
+Plane Plane_create(Vec3 center, float width, float height, float yaw, float pitch, Material material);
+float Plane_intersect(Plane *plane, Vec3 start, Vec3 rayDir, Vec3 *localHitPoint);
+Vec3 Plane_normal(Plane *plane, Vec3 localHitPoint);
+Aabb Plane_bounds(Plane *plane);
+
+Sphere Sphere_create(Vec3 center, float radius, Material material);
+float Sphere_intersect(Sphere *sphere, Vec3 start, Vec3 rayDir, Vec3 *localHitPoint);
+Vec3 Sphere_normal(Sphere *sphere, Vec3 localHitPoint);
+Aabb Sphere_bounds(Sphere *sphere);
+
+// Mirror of the sphere centers and squared radii in separate arrays, so that a kernel can test one ray against several spheres at once
+typedef struct SpherePack
+{
+    float *centerX;
+    float *centerY;
+    float *centerZ;
+    float *radiusSq;
+    int count;
+    int size;
+} SpherePack;
+
+SpherePack *SpherePack_create();
+int SpherePack_add(SpherePack *pack, Vec3 center, float radius);
+int SpherePack_intersect(SpherePack *pack, Vec3 start, Vec3 rayDir, float *maxT, CpuLevel level);
+int SpherePack_occluded(SpherePack *pack, Vec3 start, Vec3 rayDir, float maxT, CpuLevel level);
+void SpherePack_destroy(SpherePack *pack);
+
+Torus Torus_create(Vec3 center, float radius, float tubeRadius, float yaw, float pitch, Material material);
+float Torus_intersect(Torus *torus, Vec3 start, Vec3 rayDir, Vec3 *localHitPoint);
+float Torus_intersectSampled(Torus *torus, Vec3 start, Vec3 rayDir, Vec3 *localHitPoint);
+Vec3 Torus_normal(Torus *torus, Vec3 localHitPoint);
+Aabb Torus_bounds(Torus *torus);
+
+#endif // SHAPES_H_INCLUDED
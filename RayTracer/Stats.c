@@ -0,0 +1,65 @@
+#include "Stats.h"
+
+extern inline int64_t Stats_ticks();
+extern inline void Stats_count(StatCounter counter, int64_t amount);
+extern inline int64_t Stats_get(StatCounter counter);
+extern inline int64_t Stats_begin();
+extern inline void Stats_end(StatTimer timer, int64_t start);
+extern inline void Stats_take(Stats *stats);
+
+#ifdef RT_STATS
+_Thread_local Stats Stats_thread;
+#endif
+
+void Stats_add(Stats *stats, const Stats *other)
+{
+    for (int i = 0; i < STAT_COUNTER_COUNT; i++)
+    {
+        stats->counters[i] += other->counters[i];
+    }
+    for (int i = 0; i < STAT_TIMER_COUNT; i++)
+    {
+        stats->ticks[i] += other->ticks[i];
+        stats->calls[i] += other->calls[i];
+    }
+}
+
+const char *Stats_getCounterName(StatCounter counter)
+{
+    switch (counter)
+    {
+    case STAT_PRIMARY_RAYS:
+        return "primary rays";
+    case STAT_SHADOW_RAYS:
+        return "shadow rays";
+    case STAT_REFLECTION_RAYS:
+        return "reflection rays";
+    case STAT_PRIMITIVE_TESTS:
+        return "primitive tests";
+    case STAT_TORUS_SOLVES:
+        return "torus solves";
+    case STAT_SAMPLED_TORUS_EVALUATIONS:
+        return "sampled torus solver evaluations";
+    case STAT_SKY_LOOKUPS:
+        return "sky lookups";
+    default:
+        return "unknown";
+    }
+}
+
+const char *Stats_getTimerName(StatTimer timer)
+{
+    switch (timer)
+    {
+    case STAT_TIMER_TRACE_HIT:
+        return "closest hit";
+    case STAT_TIMER_DIFFUSE:
+        return "diffuse lighting";
+    case STAT_TIMER_TORUS_SOLVER:
+        return "torus solver";
+    case STAT_TIMER_FRAMEBUFFER:
+        return "framebuffer writes";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+#include <stdint.h>
+
+#include "Cpu.h"
+
+/*
+    Profiling counters and timers, kept per thread and collected with Stats_take. They are only compiled in
+    when RT_STATS is defined. Otherwise every function here is empty and inlines away, and Stats_take leaves
+    the totals at zero.
+*/
+
+/*
+    STAT_PRIMITIVE_TESTS counts ray-primitive intersection tests, a sphere pack counts every sphere it holds.
+    STAT_SAMPLED_TORUS_EVALUATIONS only counts TORUS_SOLVER_SAMPLED, the analytic solver does not sample the
+    torus function.
+*/
+typedef enum StatCounter
+{
+    STAT_PRIMARY_RAYS,
+    STAT_SHADOW_RAYS,
+    STAT_REFLECTION_RAYS,
+    STAT_PRIMITIVE_TESTS,
+    STAT_TORUS_SOLVES,
+    STAT_SAMPLED_TORUS_EVALUATIONS,
+    STAT_SKY_LOOKUPS,
+    STAT_COUNTER_COUNT
+} StatCounter;
+
+/*
+    Timed sections nest, the torus solver's time is also part of the closest hit or lighting that traced the
+    ray. The wavefront tracer lights hits over several stages, so it records no diffuse lighting time.
+*/
+typedef enum StatTimer
+{
+    STAT_TIMER_TRACE_HIT,
+    STAT_TIMER_DIFFUSE,
+    STAT_TIMER_TORUS_SOLVER,
+    STAT_TIMER_FRAMEBUFFER,
+    STAT_TIMER_COUNT
+} StatTimer;
+
+typedef struct Stats
+{
+    int64_t counters[STAT_COUNTER_COUNT];
+    // Time spent in each section, in Stats_ticks units, and how many times it was entered
+    int64_t ticks[STAT_TIMER_COUNT];
+    int64_t calls[STAT_TIMER_COUNT];
+} Stats;
+
+#ifdef RT_STATS
+#define STATS_ENABLED 1
+extern _Thread_local Stats Stats_thread;
+#else
+#define STATS_ENABLED 0
+#endif
+
+#if CPU_DISPATCH && defined(RT_STATS)
+#include <x86intrin.h>
+#elif defined(RT_STATS)
+#include "Timer.h"
+#endif
+
+// Processor cycles where the time stamp counter is available, microseconds elsewhere
+CPU_INLINE int64_t Stats_ticks()
+{
+#if CPU_DISPATCH && defined(RT_STATS)
+    return (int64_t) __rdtsc();
+#elif defined(RT_STATS)
+    return Timer_getMicroseconds();
+#else
+    return 0;
+#endif
+}
+
+CPU_INLINE void Stats_count(StatCounter counter, int64_t amount)
+{
+#ifdef RT_STATS
+    Stats_thread.counters[counter] += amount;
+#endif
+}
+
+// What the calling thread has counted since its last Stats_take
+CPU_INLINE int64_t Stats_get(StatCounter counter)
+{
+#ifdef RT_STATS
+    return Stats_thread.counters[counter];
+#else
+    return 0;
+#endif
+}
+
+// Returns the start to hand to Stats_end when the section is left
+CPU_INLINE int64_t Stats_begin()
+{
+    return Stats_ticks();
+}
+
+CPU_INLINE void Stats_end(StatTimer timer, int64_t start)
+{
+#ifdef RT_STATS
+    Stats_thread.ticks[timer] += Stats_ticks() - start;
+    Stats_thread.calls[timer]++;
+#endif
+}
+
+// Adds what the calling thread recorded since its last call to stats, then starts over
+CPU_INLINE void Stats_take(Stats *stats)
+{
+#ifdef RT_STATS
+    for (int i = 0; i < STAT_COUNTER_COUNT; i++)
+    {
+        stats->counters[i] += Stats_thread.counters[i];
+    }
+    for (int i = 0; i < STAT_TIMER_COUNT; i++)
+    {
+        stats->ticks[i] += Stats_thread.ticks[i];
+        stats->calls[i] += Stats_thread.calls[i];
+    }
+    Stats_thread = (Stats) {0};
+#endif
+}
+
+void Stats_add(Stats *stats, const Stats *other);
+
+const char *Stats_getCounterName(StatCounter counter);
+const char *Stats_getTimerName(StatTimer timer);
+
+#endif // STATS_H_INCLUDED
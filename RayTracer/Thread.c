@@ -0,0 +1,241 @@
+#include "Thread.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+
+struct Thread
+{
+    HANDLE handle;
+    void (*func)(void *data);
+    void *data;
+};
+
+struct Mutex
+{
+    CRITICAL_SECTION section;
+};
+
+struct Condition
+{
+    CONDITION_VARIABLE variable;
+};
+
+static DWORD WINAPI Thread_entry(LPVOID param)
+{
+    Thread *thread = (Thread*) param;
+    thread->func(thread->data);
+    return 0;
+}
+
+Thread *Thread_create(void (*func)(void *data), void *data)
+{
+    Thread *thread = malloc(sizeof *thread);
+    if (thread)
+    {
+        thread->func = func;
+        thread->data = data;
+        thread->handle = CreateThread(NULL, 0, Thread_entry, thread, 0, NULL);
+        if (!thread->handle)
+        {
+            free(thread);
+            thread = NULL;
+        }
+    }
+    return thread;
+}
+
+// Waits for the thread to finish and frees it
+void Thread_join(Thread *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+
+    free(thread);
+}
+
+int Thread_getProcessorCount()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int) info.dwNumberOfProcessors : 1;
+}
+
+Mutex *Mutex_create()
+{
+    Mutex *mutex = malloc(sizeof *mutex);
+    if (mutex)
+    {
+        InitializeCriticalSection(&mutex->section);
+    }
+    return mutex;
+}
+
+void Mutex_lock(Mutex *mutex)
+{
+    EnterCriticalSection(&mutex->section);
+}
+
+void Mutex_unlock(Mutex *mutex)
+{
+    LeaveCriticalSection(&mutex->section);
+}
+
+void Mutex_destroy(Mutex *mutex)
+{
+    DeleteCriticalSection(&mutex->section);
+
+    free(mutex);
+}
+
+Condition *Condition_create()
+{
+    Condition *condition = malloc(sizeof *condition);
+    if (condition)
+    {
+        InitializeConditionVariable(&condition->variable);
+    }
+    return condition;
+}
+
+void Condition_wait(Condition *condition, Mutex *mutex)
+{
+    SleepConditionVariableCS(&condition->variable, &mutex->section, INFINITE);
+}
+
+void Condition_signal(Condition *condition)
+{
+    WakeConditionVariable(&condition->variable);
+}
+
+void Condition_broadcast(Condition *condition)
+{
+    WakeAllConditionVariable(&condition->variable);
+}
+
+void Condition_destroy(Condition *condition)
+{
+    free(condition);
+}
+
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+struct Thread
+{
+    pthread_t handle;
+    void (*func)(void *data);
+    void *data;
+};
+
+struct Mutex
+{
+    pthread_mutex_t mutex;
+};
+
+struct Condition
+{
+    pthread_cond_t cond;
+};
+
+static void *Thread_entry(void *param)
+{
+    Thread *thread = (Thread*) param;
+    thread->func(thread->data);
+    return NULL;
+}
+
+Thread *Thread_create(void (*func)(void *data), void *data)
+{
+    Thread *thread = malloc(sizeof *thread);
+    if (thread)
+    {
+        thread->func = func;
+        thread->data = data;
+        if (pthread_create(&thread->handle, NULL, Thread_entry, thread) != 0)
+        {
+            free(thread);
+            thread = NULL;
+        }
+    }
+    return thread;
+}
+
+// Waits for the thread to finish and frees it
+void Thread_join(Thread *thread)
+{
+    pthread_join(thread->handle, NULL);
+
+    free(thread);
+}
+
+int Thread_getProcessorCount()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int) count : 1;
+}
+
+Mutex *Mutex_create()
+{
+    Mutex *mutex = malloc(sizeof *mutex);
+    if (mutex && pthread_mutex_init(&mutex->mutex, NULL) != 0)
+    {
+        free(mutex);
+        mutex = NULL;
+    }
+    return mutex;
+}
+
+void Mutex_lock(Mutex *mutex)
+{
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+void Mutex_unlock(Mutex *mutex)
+{
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+void Mutex_destroy(Mutex *mutex)
+{
+    pthread_mutex_destroy(&mutex->mutex);
+
+    free(mutex);
+}
+
+Condition *Condition_create()
+{
+    Condition *condition = malloc(sizeof *condition);
+    if (condition && pthread_cond_init(&condition->cond, NULL) != 0)
+    {
+        free(condition);
+        condition = NULL;
+    }
+    return condition;
+}
+
+void Condition_wait(Condition *condition, Mutex *mutex)
+{
+    pthread_cond_wait(&condition->cond, &mutex->mutex);
+}
+
+void Condition_signal(Condition *condition)
+{
+    pthread_cond_signal(&condition->cond);
+}
+
+void Condition_broadcast(Condition *condition)
+{
+    pthread_cond_broadcast(&condition->cond);
+}
+
+void Condition_destroy(Condition *condition)
+{
+    pthread_cond_destroy(&condition->cond);
+
+    free(condition);
+}
+
+#endif
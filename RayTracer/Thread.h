@@ -0,0 +1,29 @@
+#ifndef THREAD_H_INCLUDED
+#define THREAD_H_INCLUDED
+
+typedef struct Thread Thread;
+typedef struct Mutex Mutex;
+typedef struct Condition Condition;
+
+Thread *Thread_create(void (*func)(void *data), void *data);
+
+void Thread_join(Thread *thread);
+
+int Thread_getProcessorCount();
+
+Mutex *Mutex_create();
+
+void Mutex_lock(Mutex *mutex);
+void Mutex_unlock(Mutex *mutex);
+
+void Mutex_destroy(Mutex *mutex);
+
+Condition *Condition_create();
+
+void Condition_wait(Condition *condition, Mutex *mutex);
+void Condition_signal(Condition *condition);
+void Condition_broadcast(Condition *condition);
+
+void Condition_destroy(Condition *condition);
+
+#endif // THREAD_H_INCLUDED
@@ -0,0 +1,11 @@
+#ifndef TIMER_H_INCLUDED
+#define TIMER_H_INCLUDED
+
+#include <stdint.h>
+
+int64_t Timer_getMicroseconds();
+
+// For timing short stretches of code, processor cycles where the time stamp counter is available and nanoseconds elsewhere
+int64_t Timer_getTicks();
+
+#endif // TIMER_H_INCLUDED
@@ -0,0 +1,467 @@
+#include "Wavefront.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+// Rays handled by one task of a stage
+#define WAVEFRONT_CHUNK 256
+
+// Vectors stored as one array per component, vector i is element i of each
+typedef struct Vec3Array
+{
+    float *x;
+    float *y;
+    float *z;
+} Vec3Array;
+
+// One array per attribute, ray i of the queue is element i of each
+typedef struct RayQueue
+{
+    Vec3Array origins;
+    Vec3Array dirs;
+    Vec3Array throughputs;
+    int *owners;
+    int count;
+} RayQueue;
+
+// One slot per candidate light of every hit, traced is 0 where the light can't reach the hit and no ray is tested
+typedef struct ShadowQueue
+{
+    Vec3Array origins;
+    Vec3Array dirs;
+    float *maxTs;
+    Vec3Array contributions;
+    uint8_t *traced;
+    uint8_t *occluded;
+    int count;
+    int size;
+} ShadowQueue;
+
+/*
+    Traces a batch of rays the way Scene_trace traces one, but a stage at a time over the whole batch. Every
+    bounce intersects the queue of rays, shades the misses with the sky and counts the candidate lights of the
+    hits, samples each candidate once into the shadow queue, tests the shadow rays that sampling produced,
+    gathers each hit's lighting and finally emits the rays that reflect into the queue of the next bounce. The rays of a queue each belong to a different
+    primary ray, their owner, so stages write results without locks.
+
+    Shadow slots and reflected rays are emitted in the order of the rays that produced them, at offsets found by
+    scanning per-ray counts. Lighting is summed in the same order as Scene_trace sums it, which keeps the
+    results identical.
+*/
+struct Wavefront
+{
+    int size;
+
+    RayQueue rays;
+    RayQueue nextRays;
+    SceneHit *hits;
+    uint8_t *hitFlags;
+    int *shadowStarts;
+    int *reflectStarts;
+    ShadowQueue shadows;
+
+    Vec3 *colors;
+    float *depths;
+
+    Scene *scene;
+    int bounce;
+
+    // With RT_STATS every stage task hands what its thread recorded to the slot of its worker
+    WorkerPool_Task stage;
+    Stats *workerStats;
+    int workerCount;
+};
+
+// Reallocates *array to hold size elements, leaving it untouched on failure
+static int Wavefront_resize(void **array, size_t elementSize, int size)
+{
+    void *newArr = realloc(*array, elementSize * size);
+    if (!newArr)
+        return 0;
+    *array = newArr;
+    return 1;
+}
+
+static int Vec3Array_resize(Vec3Array *array, int size)
+{
+    return Wavefront_resize((void**) &array->x, sizeof *array->x, size)
+        && Wavefront_resize((void**) &array->y, sizeof *array->y, size)
+        && Wavefront_resize((void**) &array->z, sizeof *array->z, size);
+}
+
+static void Vec3Array_free(Vec3Array *array)
+{
+    free(array->x);
+    free(array->y);
+    free(array->z);
+}
+
+static inline Vec3 Vec3Array_get(const Vec3Array *array, int i)
+{
+    return (Vec3) {array->x[i], array->y[i], array->z[i]};
+}
+
+static inline void Vec3Array_set(Vec3Array *array, int i, Vec3 v)
+{
+    array->x[i] = v.x;
+    array->y[i] = v.y;
+    array->z[i] = v.z;
+}
+
+static int RayQueue_resize(RayQueue *queue, int size)
+{
+    return Vec3Array_resize(&queue->origins, size)
+        && Vec3Array_resize(&queue->dirs, size)
+        && Vec3Array_resize(&queue->throughputs, size)
+        && Wavefront_resize((void**) &queue->owners, sizeof *queue->owners, size);
+}
+
+static void RayQueue_free(RayQueue *queue)
+{
+    Vec3Array_free(&queue->origins);
+    Vec3Array_free(&queue->dirs);
+    Vec3Array_free(&queue->throughputs);
+    free(queue->owners);
+}
+
+static void ShadowQueue_free(ShadowQueue *queue)
+{
+    Vec3Array_free(&queue->origins);
+    Vec3Array_free(&queue->dirs);
+    free(queue->maxTs);
+    Vec3Array_free(&queue->contributions);
+    free(queue->traced);
+    free(queue->occluded);
+}
+
+static int ShadowQueue_reserve(ShadowQueue *queue, int count)
+{
+    if (count <= queue->size)
+        return 1;
+
+    int newSize = queue->size > 0 ? queue->size : 1;
+    while (newSize < count)
+    {
+        newSize *= 2;
+    }
+    if (Vec3Array_resize(&queue->origins, newSize)
+        && Vec3Array_resize(&queue->dirs, newSize)
+        && Wavefront_resize((void**) &queue->maxTs, sizeof *queue->maxTs, newSize)
+        && Vec3Array_resize(&queue->contributions, newSize)
+        && Wavefront_resize((void**) &queue->traced, sizeof *queue->traced, newSize)
+        && Wavefront_resize((void**) &queue->occluded, sizeof *queue->occluded, newSize))
+    {
+        queue->size = newSize;
+        return 1;
+    }
+    return 0;
+}
+
+Wavefront *Wavefront_create()
+{
+    Wavefront *wavefront = calloc(1, sizeof *wavefront);
+    return wavefront;
+}
+
+int Wavefront_begin(Wavefront *wavefront, int maxRays)
+{
+    wavefront->rays.count = 0;
+    if (maxRays > wavefront->size)
+    {
+        int newSize = wavefront->size > 0 ? wavefront->size : 1;
+        while (newSize < maxRays)
+        {
+            newSize *= 2;
+        }
+        if (!RayQueue_resize(&wavefront->rays, newSize) || !RayQueue_resize(&wavefront->nextRays, newSize)
+            || !Wavefront_resize((void**) &wavefront->hits, sizeof *wavefront->hits, newSize)
+            || !Wavefront_resize((void**) &wavefront->hitFlags, sizeof *wavefront->hitFlags, newSize)
+            || !Wavefront_resize((void**) &wavefront->shadowStarts, sizeof *wavefront->shadowStarts, newSize + 1)
+            || !Wavefront_resize((void**) &wavefront->reflectStarts, sizeof *wavefront->reflectStarts, newSize + 1)
+            || !Wavefront_resize((void**) &wavefront->colors, sizeof *wavefront->colors, newSize)
+            || !Wavefront_resize((void**) &wavefront->depths, sizeof *wavefront->depths, newSize))
+        {
+            return 0;
+        }
+        wavefront->size = newSize;
+    }
+    return 1;
+}
+
+int Wavefront_addRay(Wavefront *wavefront, Vec3 start, Vec3 dir)
+{
+    int ray = wavefront->rays.count++;
+    Vec3Array_set(&wavefront->rays.origins, ray, start);
+    Vec3Array_set(&wavefront->rays.dirs, ray, dir);
+    Vec3Array_set(&wavefront->rays.throughputs, ray, (Vec3) {1.0f, 1.0f, 1.0f});
+    wavefront->rays.owners[ray] = ray;
+    wavefront->colors[ray] = (Vec3) {0.0f, 0.0f, 0.0f};
+    return ray;
+}
+
+static int Wavefront_chunkEnd(int taskIndex, int count)
+{
+    return (taskIndex + 1) * WAVEFRONT_CHUNK < count ? (taskIndex + 1) * WAVEFRONT_CHUNK : count;
+}
+
+static void Wavefront_intersectTask(int taskIndex, int workerIndex, void *data)
+{
+    Wavefront *wavefront = (Wavefront*) data;
+    RayQueue *rays = &wavefront->rays;
+
+    for (int i = taskIndex * WAVEFRONT_CHUNK; i < Wavefront_chunkEnd(taskIndex, rays->count); i++)
+    {
+        int hit = Scene_intersect(wavefront->scene, Vec3Array_get(&rays->origins, i), Vec3Array_get(&rays->dirs, i),
+            &wavefront->hits[i]);
+        wavefront->hitFlags[i] = hit;
+        if (wavefront->bounce == 0)
+        {
+            wavefront->depths[rays->owners[i]] = hit ? wavefront->hits[i].t : INFINITY;
+        }
+    }
+}
+
+static void Wavefront_shadeTask(int taskIndex, int workerIndex, void *data)
+{
+    Wavefront *wavefront = (Wavefront*) data;
+    RayQueue *rays = &wavefront->rays;
+    Scene *scene = wavefront->scene;
+
+    for (int i = taskIndex * WAVEFRONT_CHUNK; i < Wavefront_chunkEnd(taskIndex, rays->count); i++)
+    {
+        int shadowCount = 0;
+        if (wavefront->hitFlags[i])
+        {
+            const int *lights;
+            shadowCount = Scene_getLightCandidates(scene, wavefront->hits[i].hitPoint, &lights);
+        }
+        else
+        {
+            Vec3 skyColor;
+            if (Scene_getSkyColor(scene, Vec3Array_get(&rays->dirs, i), wavefront->bounce, &skyColor))
+            {
+                Vec3 *color = &wavefront->colors[rays->owners[i]];
+                *color = Vec3_add(*color, Vec3_mul(Vec3Array_get(&rays->throughputs, i), skyColor));
+            }
+        }
+        wavefront->shadowStarts[i] = shadowCount;
+    }
+}
+
+static void Wavefront_emitShadowsTask(int taskIndex, int workerIndex, void *data)
+{
+    Wavefront *wavefront = (Wavefront*) data;
+    ShadowQueue *shadows = &wavefront->shadows;
+    Scene *scene = wavefront->scene;
+
+    for (int i = taskIndex * WAVEFRONT_CHUNK; i < Wavefront_chunkEnd(taskIndex, wavefront->rays.count); i++)
+    {
+        if (!wavefront->hitFlags[i])
+            continue;
+
+        SceneHit *hit = &wavefront->hits[i];
+        int s = wavefront->shadowStarts[i];
+        const int *lights;
+        int count = Scene_getLightCandidates(scene, hit->hitPoint, &lights);
+        for (int l = 0; l < count; l++, s++)
+        {
+            Vec3 dir, contribution;
+            shadows->traced[s] = Scene_getShadowRay(scene, hit, lights ? lights[l] : l, &dir, &shadows->maxTs[s], &contribution);
+            Vec3Array_set(&shadows->origins, s, hit->hitPoint);
+            Vec3Array_set(&shadows->dirs, s, dir);
+            Vec3Array_set(&shadows->contributions, s, contribution);
+        }
+    }
+}
+
+static void Wavefront_occludeTask(int taskIndex, int workerIndex, void *data)
+{
+    Wavefront *wavefront = (Wavefront*) data;
+    ShadowQueue *shadows = &wavefront->shadows;
+
+    for (int s = taskIndex * WAVEFRONT_CHUNK; s < Wavefront_chunkEnd(taskIndex, shadows->count); s++)
+    {
+        if (shadows->traced[s])
+        {
+            Stats_count(STAT_SHADOW_RAYS, 1);
+            shadows->occluded[s] = Scene_occluded(wavefront->scene, Vec3Array_get(&shadows->origins, s),
+                Vec3Array_get(&shadows->dirs, s), shadows->maxTs[s]);
+        }
+    }
+}
+
+// Adds up the lighting of each hit and decides which rays reflect, leaving the reflected direction and throughput in place
+static void Wavefront_gatherTask(int taskIndex, int workerIndex, void *data)
+{
+    Wavefront *wavefront = (Wavefront*) data;
+    RayQueue *rays = &wavefront->rays;
+    ShadowQueue *shadows = &wavefront->shadows;
+
+    for (int i = taskIndex * WAVEFRONT_CHUNK; i < Wavefront_chunkEnd(taskIndex, rays->count); i++)
+    {
+        int reflects = 0;
+        if (wavefront->hitFlags[i])
+        {
+            SceneHit *hit = &wavefront->hits[i];
+            Vec3 diffuse = Scene_getAmbientLight(wavefront->scene);
+            for (int s = wavefront->shadowStarts[i]; s < wavefront->shadowStarts[i + 1]; s++)
+            {
+                if (shadows->traced[s] && !shadows->occluded[s])
+                {
+                    diffuse = Vec3_add(diffuse, Vec3Array_get(&shadows->contributions, s));
+                }
+            }
+
+            Vec3 throughput = Vec3Array_get(&rays->throughputs, i);
+            Vec3 *color = &wavefront->colors[rays->owners[i]];
+            *color = Vec3_add(*color, Vec3_mul(throughput, Vec3_mul(diffuse, hit->material.diffuse)));
+
+            Vec3 dir = Vec3Array_get(&rays->dirs, i);
+            reflects = Scene_reflect(wavefront->scene, hit, wavefront->bounce, &throughput, &dir);
+            if (reflects)
+            {
+                Vec3Array_set(&rays->throughputs, i, throughput);
+                Vec3Array_set(&rays->dirs, i, dir);
+            }
+        }
+        wavefront->reflectStarts[i] = reflects;
+    }
+}
+
+static void Wavefront_emitReflectionsTask(int taskIndex, int workerIndex, void *data)
+{
+    Wavefront *wavefront = (Wavefront*) data;
+    RayQueue *rays = &wavefront->rays;
+    RayQueue *next = &wavefront->nextRays;
+
+    for (int i = taskIndex * WAVEFRONT_CHUNK; i < Wavefront_chunkEnd(taskIndex, rays->count); i++)
+    {
+        int r = wavefront->reflectStarts[i];
+        if (r < wavefront->reflectStarts[i + 1])
+        {
+            Vec3Array_set(&next->origins, r, wavefront->hits[i].hitPoint);
+            Vec3Array_set(&next->dirs, r, Vec3Array_get(&rays->dirs, i));
+            Vec3Array_set(&next->throughputs, r, Vec3Array_get(&rays->throughputs, i));
+            next->owners[r] = rays->owners[i];
+        }
+    }
+}
+
+// Turns count per-element counts into offsets, starts[count] receives the total which is also returned
+static int Wavefront_scan(int starts[], int count)
+{
+    int total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int n = starts[i];
+        starts[i] = total;
+        total += n;
+    }
+    starts[count] = total;
+    return total;
+}
+
+static void Wavefront_statsTask(int taskIndex, int workerIndex, void *data)
+{
+    Wavefront *wavefront = (Wavefront*) data;
+    wavefront->stage(taskIndex, workerIndex, data);
+    Stats_take(&wavefront->workerStats[workerIndex]);
+}
+
+static void Wavefront_runStage(Wavefront *wavefront, WorkerPool *pool, int count, WorkerPool_Task task)
+{
+    if (wavefront->workerStats)
+    {
+        wavefront->stage = task;
+        task = Wavefront_statsTask;
+    }
+    WorkerPool_run(pool, (count + WAVEFRONT_CHUNK - 1) / WAVEFRONT_CHUNK, task, wavefront);
+}
+
+/*
+    Traces the rays added since Wavefront_begin. If the shadow queue cannot grow the bounce is shaded with
+    ambient light only and no further bounces are traced, the results are then no longer exact.
+*/
+void Wavefront_trace(Wavefront *wavefront, Scene *scene, WorkerPool *pool)
+{
+    wavefront->scene = scene;
+    wavefront->bounce = 0;
+    if (STATS_ENABLED && !wavefront->workerStats)
+    {
+        wavefront->workerStats = calloc(WorkerPool_getThreadCount(pool), sizeof *wavefront->workerStats);
+        wavefront->workerCount = wavefront->workerStats ? WorkerPool_getThreadCount(pool) : 0;
+    }
+    while (wavefront->rays.count > 0)
+    {
+        RayQueue *rays = &wavefront->rays;
+        Stats_count(wavefront->bounce == 0 ? STAT_PRIMARY_RAYS : STAT_REFLECTION_RAYS, rays->count);
+        Wavefront_runStage(wavefront, pool, rays->count, Wavefront_intersectTask);
+        Wavefront_runStage(wavefront, pool, rays->count, Wavefront_shadeTask);
+
+        wavefront->shadows.count = Wavefront_scan(wavefront->shadowStarts, rays->count);
+        int shadowsFit = ShadowQueue_reserve(&wavefront->shadows, wavefront->shadows.count);
+        if (!shadowsFit)
+        {
+            for (int i = 0; i <= rays->count; i++)
+            {
+                wavefront->shadowStarts[i] = 0;
+            }
+            wavefront->shadows.count = 0;
+        }
+        else
+        {
+            Wavefront_runStage(wavefront, pool, rays->count, Wavefront_emitShadowsTask);
+            Wavefront_runStage(wavefront, pool, wavefront->shadows.count, Wavefront_occludeTask);
+        }
+        Wavefront_runStage(wavefront, pool, rays->count, Wavefront_gatherTask);
+
+        int nextCount = shadowsFit ? Wavefront_scan(wavefront->reflectStarts, rays->count) : 0;
+        if (nextCount > 0)
+        {
+            Wavefront_runStage(wavefront, pool, rays->count, Wavefront_emitReflectionsTask);
+        }
+
+        RayQueue temp = wavefront->rays;
+        wavefront->rays = wavefront->nextRays;
+        wavefront->nextRays = temp;
+        wavefront->rays.count = nextCount;
+        wavefront->bounce++;
+    }
+}
+
+Vec3 Wavefront_getColor(Wavefront *wavefront, int ray)
+{
+    return wavefront->colors[ray];
+}
+
+float Wavefront_getDepth(Wavefront *wavefront, int ray)
+{
+    return wavefront->depths[ray];
+}
+
+void Wavefront_takeStats(Wavefront *wavefront, Stats *stats)
+{
+    // Rays are counted per bounce on the calling thread, the stage tasks hand theirs over as they finish
+    Stats_take(stats);
+    for (int i = 0; i < wavefront->workerCount; i++)
+    {
+        Stats_add(stats, &wavefront->workerStats[i]);
+        wavefront->workerStats[i] = (Stats) {0};
+    }
+}
+
+void Wavefront_destroy(Wavefront *wavefront)
+{
+    RayQueue_free(&wavefront->rays);
+    RayQueue_free(&wavefront->nextRays);
+    free(wavefront->hits);
+    free(wavefront->hitFlags);
+    free(wavefront->shadowStarts);
+    free(wavefront->reflectStarts);
+    ShadowQueue_free(&wavefront->shadows);
+    free(wavefront->colors);
+    free(wavefront->depths);
+    free(wavefront->workerStats);
+    free(wavefront);
+}
@@ -0,0 +1,33 @@
+#ifndef WAVEFRONT_H_INCLUDED
+#define WAVEFRONT_H_INCLUDED
+
+#include "Vec3.h"
+#include "Scene.h"
+#include "WorkerPool.h"
+#include "Stats.h"
+
+typedef struct Wavefront Wavefront;
+
+Wavefront *Wavefront_create();
+
+// Empties the wavefront and makes room for maxRays primary rays, returns 0 if that fails
+int Wavefront_begin(Wavefront *wavefront, int maxRays);
+
+// Returns the index the ray's results are found at
+int Wavefront_addRay(Wavefront *wavefront, Vec3 start, Vec3 dir);
+
+void Wavefront_trace(Wavefront *wavefront, Scene *scene, WorkerPool *pool);
+
+// Results of primary ray 'ray', the same as Scene_trace returns for it
+Vec3 Wavefront_getColor(Wavefront *wavefront, int ray);
+float Wavefront_getDepth(Wavefront *wavefront, int ray);
+
+/*
+    Adds the profiling stats recorded since the last call to stats, then starts over. They include the rays
+    traced and stay at zero unless built with RT_STATS. Must be called on the thread that ran Wavefront_trace.
+*/
+void Wavefront_takeStats(Wavefront *wavefront, Stats *stats);
+
+void Wavefront_destroy(Wavefront *wavefront);
+
+#endif // WAVEFRONT_H_INCLUDED
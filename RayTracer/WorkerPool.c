@@ -0,0 +1,299 @@
+#include "WorkerPool.h"
+
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "Thread.h"
+#include "Timer.h"
+
+/*
+    Each worker owns a deque of task indices. Because tasks are only ever handed out as contiguous
+    ranges, a deque is just [top, bottom) packed into one 64 bit word: the owner pops from the bottom,
+    thieves take the upper half from the top, and both sides claim work with a single compare-and-swap.
+*/
+#define DEQUE_PACK(top, bottom) (((uint64_t) (uint32_t) (top) << 32) | (uint32_t) (bottom))
+#define DEQUE_TOP(state) ((int) ((state) >> 32))
+#define DEQUE_BOTTOM(state) ((int) ((state) & 0xFFFFFFFFu))
+
+typedef struct Worker
+{
+    _Atomic uint64_t deque;
+    WorkerPool *pool;
+    int index;
+    Thread *thread;
+    WorkerStats stats;
+    int64_t runBusyMicroseconds;
+    char padding[64];
+} Worker;
+
+struct WorkerPool
+{
+    int threadCount;
+    Worker *workers;
+
+    Mutex *mutex;
+    Condition *startCondition;
+    Condition *doneCondition;
+    int generation;
+    int busyWorkers;
+    int quit;
+
+    int taskCount;
+    WorkerPool_Task task;
+    void *data;
+
+    // Workers update their own stats without locks while running. Other threads only see the copy published under the mutex after each run.
+    WorkerStats *publishedStats;
+    int statsResetPending;
+};
+
+static int WorkerPool_popTask(Worker *worker)
+{
+    uint64_t state = atomic_load(&worker->deque);
+    while (DEQUE_TOP(state) < DEQUE_BOTTOM(state))
+    {
+        int task = DEQUE_BOTTOM(state) - 1;
+        if (atomic_compare_exchange_weak(&worker->deque, &state, DEQUE_PACK(DEQUE_TOP(state), task)))
+        {
+            return task;
+        }
+    }
+    return -1;
+}
+
+// Takes the upper half of another worker's deque, keeps the first stolen task to run and makes the rest stealable again
+static int WorkerPool_stealTask(WorkerPool *pool, Worker *thief)
+{
+    for (int i = 1; i < pool->threadCount; i++)
+    {
+        Worker *victim = &pool->workers[(thief->index + i) % pool->threadCount];
+        uint64_t state = atomic_load(&victim->deque);
+        while (DEQUE_TOP(state) < DEQUE_BOTTOM(state))
+        {
+            int top = DEQUE_TOP(state);
+            int count = (DEQUE_BOTTOM(state) - top + 1) / 2;
+            if (atomic_compare_exchange_weak(&victim->deque, &state, DEQUE_PACK(top + count, DEQUE_BOTTOM(state))))
+            {
+                atomic_store(&thief->deque, DEQUE_PACK(top + 1, top + count));
+                thief->stats.steals++;
+                thief->stats.stolenTasks += count;
+                return top;
+            }
+        }
+    }
+    return -1;
+}
+
+static void WorkerPool_work(WorkerPool *pool, int workerIndex)
+{
+    Worker *worker = &pool->workers[workerIndex];
+    int64_t busyStart = Timer_getMicroseconds();
+
+    int task;
+    while ((task = WorkerPool_popTask(worker)) >= 0 || (task = WorkerPool_stealTask(pool, worker)) >= 0)
+    {
+        pool->task(task, workerIndex, pool->data);
+        worker->stats.tasks++;
+    }
+
+    worker->runBusyMicroseconds = Timer_getMicroseconds() - busyStart;
+    worker->stats.busyMicroseconds += worker->runBusyMicroseconds;
+}
+
+static void WorkerPool_threadMain(void *data)
+{
+    Worker *worker = (Worker*) data;
+    WorkerPool *pool = worker->pool;
+    int seenGeneration = 0;
+
+    Mutex_lock(pool->mutex);
+    while (1)
+    {
+        while (pool->generation == seenGeneration && !pool->quit)
+        {
+            Condition_wait(pool->startCondition, pool->mutex);
+        }
+        if (pool->quit)
+            break;
+        seenGeneration = pool->generation;
+        Mutex_unlock(pool->mutex);
+
+        WorkerPool_work(pool, worker->index);
+
+        Mutex_lock(pool->mutex);
+        if (--pool->busyWorkers == 0)
+        {
+            Condition_signal(pool->doneCondition);
+        }
+    }
+    Mutex_unlock(pool->mutex);
+}
+
+// A threadCount below 1 uses one thread per processor. The calling thread is worker 0.
+WorkerPool *WorkerPool_create(int threadCount)
+{
+    WorkerPool *pool = malloc(sizeof *pool);
+    if (pool)
+    {
+        pool->threadCount = threadCount < 1 ? Thread_getProcessorCount() : threadCount;
+        pool->generation = 0;
+        pool->busyWorkers = 0;
+        pool->quit = 0;
+        pool->taskCount = 0;
+        pool->task = NULL;
+        pool->data = NULL;
+        pool->statsResetPending = 0;
+
+        pool->workers = calloc(pool->threadCount, sizeof *pool->workers);
+        pool->publishedStats = calloc(pool->threadCount, sizeof *pool->publishedStats);
+        if (pool->workers)
+        {
+            for (int i = 0; i < pool->threadCount; i++)
+            {
+                atomic_init(&pool->workers[i].deque, DEQUE_PACK(0, 0));
+            }
+        }
+        pool->mutex = Mutex_create();
+        pool->startCondition = Condition_create();
+        pool->doneCondition = Condition_create();
+        if (!pool->workers || !pool->publishedStats || !pool->mutex || !pool->startCondition || !pool->doneCondition)
+        {
+            WorkerPool_destroy(pool);
+            pool = NULL;
+        }
+        else
+        {
+            for (int i = 1; i < pool->threadCount; i++)
+            {
+                Worker *worker = &pool->workers[i];
+                worker->pool = pool;
+                worker->index = i;
+                worker->thread = Thread_create(WorkerPool_threadMain, worker);
+                if (!worker->thread)
+                {
+                    WorkerPool_destroy(pool);
+                    pool = NULL;
+                    break;
+                }
+            }
+        }
+    }
+    return pool;
+}
+
+int WorkerPool_getThreadCount(WorkerPool *pool)
+{
+    return pool->threadCount;
+}
+
+// Runs task(0 .. taskCount - 1) across all workers and returns once every task has finished
+void WorkerPool_run(WorkerPool *pool, int taskCount, WorkerPool_Task task, void *data)
+{
+    pool->taskCount = taskCount;
+    pool->task = task;
+    pool->data = data;
+
+    // Seed every deque with an equal contiguous share, neighbouring rows tend to cost the same
+    for (int i = 0; i < pool->threadCount; i++)
+    {
+        int start = (int) ((int64_t) taskCount * i / pool->threadCount);
+        int end = (int) ((int64_t) taskCount * (i + 1) / pool->threadCount);
+        atomic_store(&pool->workers[i].deque, DEQUE_PACK(start, end));
+    }
+
+    int64_t runStart = Timer_getMicroseconds();
+
+    // No worker is running here, so a requested reset can clear their stats
+    Mutex_lock(pool->mutex);
+    if (pool->statsResetPending)
+    {
+        for (int i = 0; i < pool->threadCount; i++)
+        {
+            pool->workers[i].stats = (WorkerStats) {0};
+        }
+        pool->statsResetPending = 0;
+    }
+    if (pool->threadCount > 1)
+    {
+        pool->busyWorkers = pool->threadCount - 1;
+        pool->generation++;
+        Condition_broadcast(pool->startCondition);
+    }
+    Mutex_unlock(pool->mutex);
+
+    WorkerPool_work(pool, 0);
+
+    if (pool->threadCount > 1)
+    {
+        Mutex_lock(pool->mutex);
+        while (pool->busyWorkers > 0)
+        {
+            Condition_wait(pool->doneCondition, pool->mutex);
+        }
+        Mutex_unlock(pool->mutex);
+    }
+
+    // Whatever part of the run a worker did not spend on tasks it spent waiting for the others
+    int64_t runTime = Timer_getMicroseconds() - runStart;
+    Mutex_lock(pool->mutex);
+    for (int i = 0; i < pool->threadCount; i++)
+    {
+        pool->workers[i].stats.idleMicroseconds += runTime - pool->workers[i].runBusyMicroseconds;
+        pool->publishedStats[i] = pool->workers[i].stats;
+    }
+    Mutex_unlock(pool->mutex);
+}
+
+/*
+    Copies the statistics of every worker, accumulated since the last reset, into stats[0 .. threadCount - 1].
+    Safe to call from any thread while runs are in progress, it sees the totals as of the last finished run.
+*/
+void WorkerPool_getStats(WorkerPool *pool, WorkerStats stats[])
+{
+    Mutex_lock(pool->mutex);
+    for (int i = 0; i < pool->threadCount; i++)
+    {
+        stats[i] = pool->publishedStats[i];
+    }
+    Mutex_unlock(pool->mutex);
+}
+
+// The workers' own totals are cleared at the start of the next run
+void WorkerPool_resetStats(WorkerPool *pool)
+{
+    Mutex_lock(pool->mutex);
+    for (int i = 0; i < pool->threadCount; i++)
+    {
+        pool->publishedStats[i] = (WorkerStats) {0};
+    }
+    pool->statsResetPending = 1;
+    Mutex_unlock(pool->mutex);
+}
+
+void WorkerPool_destroy(WorkerPool *pool)
+{
+    if (pool->mutex && pool->startCondition)
+    {
+        Mutex_lock(pool->mutex);
+        pool->quit = 1;
+        Condition_broadcast(pool->startCondition);
+        Mutex_unlock(pool->mutex);
+    }
+    if (pool->workers)
+    {
+        for (int i = 1; i < pool->threadCount; i++)
+        {
+            if (pool->workers[i].thread)
+            {
+                Thread_join(pool->workers[i].thread);
+            }
+        }
+    }
+    if (pool->mutex) Mutex_destroy(pool->mutex);
+    if (pool->startCondition) Condition_destroy(pool->startCondition);
+    if (pool->doneCondition) Condition_destroy(pool->doneCondition);
+    free(pool->workers);
+    free(pool->publishedStats);
+
+    free(pool);
+}
@@ -0,0 +1,30 @@
+#ifndef WORKERPOOL_H_INCLUDED
+#define WORKERPOOL_H_INCLUDED
+
+#include <stdint.h>
+
+typedef struct WorkerPool WorkerPool;
+
+typedef void (*WorkerPool_Task)(int taskIndex, int workerIndex, void *data);
+
+typedef struct WorkerStats
+{
+    int64_t tasks;
+    int64_t steals;
+    int64_t stolenTasks;
+    int64_t busyMicroseconds;
+    int64_t idleMicroseconds;
+} WorkerStats;
+
+WorkerPool *WorkerPool_create(int threadCount);
+
+int WorkerPool_getThreadCount(WorkerPool *pool);
+
+void WorkerPool_run(WorkerPool *pool, int taskCount, WorkerPool_Task task, void *data);
+
+void WorkerPool_getStats(WorkerPool *pool, WorkerStats stats[]);
+void WorkerPool_resetStats(WorkerPool *pool);
+
+void WorkerPool_destroy(WorkerPool *pool);
+
+#endif // WORKERPOOL_H_INCLUDED
@@ -12,12 +12,17 @@
 #include "Vec3.h"
 #include "MathFunctions.h"
 #include "Images.h"
+#include "MappedImage.h"
 #include "CurvePath.h"
 
 void closeCallback(GLFWwindow *window);
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void mouseMoveCallback(GLFWwindow* window, double dx, double dy);
 
+void printWorkerStats(RayTracingEngine *engine);
+
+void uploadDirtyRows(Framebuffer *buffer);
+
 void fatalError(char *str);
 
 GLuint loadShaders(const char *vertexShader, const char *fragmentShader);
@@ -63,6 +68,8 @@ int main(int argc, char **argv)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Rows are uploaded straight out of the tightly packed framebuffer, whatever the width
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     GLuint vao;
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
@@ -95,7 +102,7 @@ int main(int argc, char **argv)
                                 "}");
     GLint texUniform = glGetUniformLocation(shader, "tex");
 
-    RayTracingEngine *engine = RayTracingEngine_create(width, height, 6, 70.0f);
+    RayTracingEngine *engine = RayTracingEngine_create(width, height, 6, 70.0f, 0, 1);
     if (!engine)
     {
         fatalError("Failed to create ray tracing engine.");
@@ -103,7 +110,22 @@ int main(int argc, char **argv)
     glfwSetWindowUserPointer(window, engine);
 
     Scene *scene = RayTracingEngine_getScene(engine);
-    Scene_setSky(scene, Images_snow, Images_snow_width, Images_snow_height, 0, 1);
+    // The sky is mapped straight from disk, a path on the command line replaces the default one
+    const char *skyPath = argc > 1 ? argv[1] : "snow.ppm";
+    MappedImage *sky = MappedImage_open(skyPath);
+    if (sky)
+    {
+        Scene_setSky(scene, MappedImage_getPixels(sky), MappedImage_getWidth(sky), MappedImage_getHeight(sky), 0, 1);
+    }
+    else
+    {
+        // Fall back to the compiled in snow image so a fresh build still has a sky
+        if (argc > 1)
+        {
+            printf("Could not load sky image %s, using the built in sky.\n", skyPath);
+        }
+        Scene_setSky(scene, Images_snow, Images_snow_width, Images_snow_height, 0, 1);
+    }
     Scene_addPointLight(scene, (Vec3) {0.0f, 0.0f, 0.0f}, (Vec3) {1.0f, 1.0f, 1.0f}, 20.0f);
 
     Scene_addTorus(scene, (Vec3) {0.0f, 0.0f, 8.0f}, 2.0f, 1.0f, 0.0f, M_PI / 2, Material_create((Vec3) {1.0f, 1.0f, 1.0f}, (Vec3) {1.0f, 1.0f, 1.0f}, 1.0f));
@@ -114,6 +136,10 @@ int main(int argc, char **argv)
     Vec3 prevPt = {0.0f, 0.0f, 0.0f};
     float t = 0.0f;
 
+    // Trace on a render thread if possible, otherwise spend a fixed number of microseconds per displayed frame
+    int async = RayTracingEngine_startAsync(engine);
+    const int64_t traceBudget = 12000;
+
     while (!glfwWindowShouldClose(window))
     {
         // Events
@@ -129,17 +155,20 @@ int main(int argc, char **argv)
             prevPt = interp;
             RayTracingEngine_moveCamera(engine, mv, 0.0f, 0.0f);
         }
-        RayTracingEngine_simulate(engine);
+        if (!async)
+        {
+            RayTracingEngine_simulateFor(engine, traceBudget);
+        }
 
         // Render buffer tuning
-        Framebuffer *renderBuffer = RayTracingEngine_getRenderBuffer(engine);
+        Framebuffer *renderBuffer = RayTracingEngine_getFrontBuffer(engine);
 
         // OpenGL rendering
         glUseProgram(shader);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texture);
         glUniform1i(texUniform, 0);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, Framebuffer_getWidth(renderBuffer), Framebuffer_getHeight(renderBuffer), GL_RGB, GL_UNSIGNED_BYTE, Framebuffer_getPixels(renderBuffer));
+        uploadDirtyRows(renderBuffer);
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), 0);
@@ -160,6 +189,10 @@ int main(int argc, char **argv)
     CurvePath_destroy(path);
 
     RayTracingEngine_destroy(engine);
+    if (sky)
+    {
+        MappedImage_close(sky);
+    }
     glfwDestroyWindow(window);
     glfwTerminate();
 
@@ -204,6 +237,10 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     {
         RayTracingEngine_moveCameraUp(eng, -moveSpeed);
     }
+    else if (key == GLFW_KEY_P && action == GLFW_PRESS)
+    {
+        printWorkerStats(eng);
+    }
 }
 
 void mouseMoveCallback(GLFWwindow* window, double x, double y)
@@ -226,6 +263,58 @@ void mouseMoveCallback(GLFWwindow* window, double x, double y)
     oldY = y;
 }
 
+void printWorkerStats(RayTracingEngine *engine)
+{
+    int threadCount = RayTracingEngine_getThreadCount(engine);
+    WorkerStats *stats = malloc(sizeof *stats * threadCount);
+    if (stats)
+    {
+        RayTracingEngine_getWorkerStats(engine, stats);
+        for (int i = 0; i < threadCount; i++)
+        {
+            printf("Worker %d: %lld tasks, %lld steals (%lld tasks), busy %.1f ms, idle %.1f ms\n", i,
+                   (long long) stats[i].tasks, (long long) stats[i].steals, (long long) stats[i].stolenTasks,
+                   stats[i].busyMicroseconds / 1000.0, stats[i].idleMicroseconds / 1000.0);
+        }
+        RayTracingEngine_resetWorkerStats(engine);
+        free(stats);
+    }
+
+    CancelStats cancelStats;
+    RayTracingEngine_getCancelStats(engine, &cancelStats);
+    printf("Cancelled by camera moves: %lld spans, %lld pixels skipped, %lld pixels discarded\n",
+           (long long) cancelStats.cancelledSpans, (long long) cancelStats.skippedPixels, (long long) cancelStats.discardedPixels);
+    RayTracingEngine_resetCancelStats(engine);
+}
+
+// Uploads only the runs of rows that changed since the last upload, and nothing at all once the image has settled
+void uploadDirtyRows(Framebuffer *buffer)
+{
+    DirtyRegion *dirty = Framebuffer_getDirtyRegion(buffer);
+    int x, y, w, h;
+    if (!DirtyRegion_getRect(dirty, &x, &y, &w, &h))
+        return;
+
+    int width = Framebuffer_getWidth(buffer);
+    uint8_t *pixels = Framebuffer_getPixels(buffer);
+    int row = y;
+    while (row < y + h)
+    {
+        if (!DirtyRegion_isRowDirty(dirty, row))
+        {
+            row++;
+            continue;
+        }
+        int runStart = row;
+        while (row < y + h && DirtyRegion_isRowDirty(dirty, row))
+        {
+            row++;
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, runStart, width, row - runStart, GL_RGB, GL_UNSIGNED_BYTE, pixels + runStart * width * 3);
+    }
+    DirtyRegion_clear(dirty);
+}
+
 void fatalError(char *str)
 {
     printf("Fatal Error: %s", str);